@@ -17,6 +17,7 @@
 #ifndef __TIZEN_APPFW_PACKAGE_MANAGER_H
 #define __TIZEN_APPFW_PACKAGE_MANAGER_H
 
+#include <stdbool.h>
 #include <tizen.h>
 
 #ifdef __cplusplus
@@ -36,6 +37,8 @@ typedef enum {
 	PACKAGE_MANAGER_ERROR_INVALID_PARAMETER = TIZEN_ERROR_INVALID_PARAMETER, /**< Invalid parameter */
 	PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY = TIZEN_ERROR_OUT_OF_MEMORY, /**< Out of memory */
 	PACKAGE_MANAGER_ERROR_IO_ERROR = TIZEN_ERROR_IO_ERROR, /**< Internal I/O error */
+	PACKAGE_MANAGER_ERROR_TIMED_OUT = TIZEN_ERROR_TIMED_OUT, /**< Time out */
+	PACKAGE_MANAGER_ERROR_CANCELED = TIZEN_ERROR_CANCELED, /**< Operation canceled */
 } package_manager_error_e;
 
 /**
@@ -65,6 +68,32 @@ typedef enum {
 	PACAKGE_MANAGER_REQUEST_MODE_QUIET,
 } package_manager_request_mode_e;
 
+/**
+ * @brief Enumeration of event dispatch mode
+ */
+typedef enum {
+	PACKAGE_MANAGER_DISPATCH_MODE_SERIAL, /**< Callbacks run one by one on the thread dispatching the package manager events */
+	PACKAGE_MANAGER_DISPATCH_MODE_PARALLEL, /**< Callbacks run on a thread pool, in order for each package */
+} package_manager_dispatch_mode_e;
+
+/**
+ * @brief Enumeration of event bus mode
+ */
+typedef enum {
+	PACKAGE_MANAGER_EVENT_BUS_NONE, /**< Listen to the package manager directly (default) */
+	PACKAGE_MANAGER_EVENT_BUS_PUBLISH, /**< Listen directly and share the events with the other processes */
+	PACKAGE_MANAGER_EVENT_BUS_ATTACH, /**< Read the events shared by another process, or listen directly if none does */
+} package_manager_event_bus_e;
+
+/**
+ * @brief Enumeration of package set change
+ */
+typedef enum {
+	PACKAGE_MANAGER_CHANGE_ADDED,
+	PACKAGE_MANAGER_CHANGE_REMOVED,
+	PACKAGE_MANAGER_CHANGE_UPDATED,
+} package_manager_change_e;
+
 /**
  * @brief Package manager handle
  */
@@ -75,6 +104,26 @@ typedef struct package_manager_s *package_manager_h;
  */
 typedef struct package_manager_request_s *package_manager_request_h;
 
+/**
+ * @brief Package manager transaction handle
+ */
+typedef struct package_manager_transaction_s *package_manager_transaction_h;
+
+/**
+ * @brief Package manager installation plan handle
+ */
+typedef struct package_manager_plan_s *package_manager_plan_h;
+
+/**
+ * @brief Package archive information handle
+ */
+typedef struct package_manager_archive_info_s *package_manager_archive_info_h;
+
+/**
+ * @brief Package manager future handle
+ */
+typedef struct package_manager_future_s *package_manager_future_h;
+
 /**
  * @brief Called when the progress of the request to the package manager changes.
  *
@@ -117,6 +166,10 @@ int package_manager_request_create(package_manager_request_h *request);
 /**
  * @brief Destroys the request handle to the package manager.
  *
+ * @remarks The transactions begun and the plans created on the request stop being reported.
+ * Transactions can then only be inspected with package_manager_transaction_foreach_member()
+ * and destroyed, plans can only be destroyed. \n
+ * The handle may be destroyed from its own callbacks, and those of its transactions and plans.
  * @param [in] request The request handle to the package manager
  * @return 0 on success, otherwise a negative error value.
  * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
@@ -177,16 +230,94 @@ int package_manager_request_set_type(package_manager_request_h request,
 int package_manager_request_set_mode(package_manager_request_h request,
 				     package_manager_request_mode_e mode);
 
+/**
+ * @brief Sets how long the requests submitted afterwards with the request handle may stay silent.
+ *
+ * @details If the package manager sends no event for a request within @a timeout milliseconds,
+ * the request is given up: package_manager_request_event_cb() is invoked once with
+ * #PACAKGE_MANAGER_EVENT_STATE_FAILED and #PACKAGE_MANAGER_ERROR_TIMED_OUT, and the library stops tracking it: events the package manager still sends for that request later are dropped,
+ * until it ends or stays silent for another @a timeout.
+ * @remarks The timeout is restarted by every event of the request, so long requests that keep reporting progress never expire.
+ * @param [in] request The request handle
+ * @param [in] timeout The timeout in milliseconds, or 0 to never give up (default)
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @see package_manager_request_set_request_timeout()
+*/
+int package_manager_request_set_timeout(package_manager_request_h request,
+					int timeout);
+
+/**
+ * @brief Sets how long an outstanding request may stay silent, overriding the timeout of the request handle.
+ *
+ * @param [in] request The request handle
+ * @param [in] id The ID of the request to the package manager
+ * @param [in] timeout The timeout in milliseconds, or 0 to never give up
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter, or the request has already finished
+ * @see package_manager_request_set_timeout()
+*/
+int package_manager_request_set_request_timeout(package_manager_request_h request,
+						int id, int timeout);
+
+/**
+ * @brief Sets the directory into which package files are copied before being installed with the request handle.
+ *
+ * @details When a staging directory is set, package_manager_request_install() hands the package manager
+ * a copy of the package file made in @a dir, so that slow or removable storage is read before submission
+ * rather than by the installer. The copy is made by the kernel, sharing the data blocks where the filesystem supports it.
+ * The copy is removed once the request finishes, fails or times out.
+ * @remarks Setting another directory, or NULL, drops the files staged ahead and not installed yet. \n
+ * The main loop never waits for a copy: package_manager_request_install() called from it installs
+ * the file from where it is if its copy is not done yet, while asynchronous installations, transactions and
+ * installation plans are only submitted once their copy is done. Installations from other threads wait for the copy.
+ * @param [in] request The request handle
+ * @param [in] dir The path of an existing directory, or NULL to install package files from where they are (default)
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter, or @a dir is not a directory
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @see package_manager_request_stage()
+ */
+int package_manager_request_set_staging_dir(package_manager_request_h request,
+					    const char *dir);
+
+/**
+ * @brief Starts copying a package file into the staging directory ahead of its installation.
+ *
+ * @details Files are copied one after the other in the background, so staging the next package
+ * overlaps the installation of the current one. Installing a file which has not been staged yet
+ * copies it first, ahead of the files still waiting.
+ * @param [in] request The request handle
+ * @param [in] path The absolute path to the package to be installed later
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter, or no staging directory is set
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @retval #PACKAGE_MANAGER_ERROR_IO_ERROR Failed to start the staging thread
+ * @pre package_manager_request_set_staging_dir() has been called.
+ * @see package_manager_request_install()
+ */
+int package_manager_request_stage(package_manager_request_h request,
+				  const char *path);
+
 /**
  * @brief Installs the package which is located at the given path.
  *
+ * @remarks With a staging directory, the copy of the package file is waited for unless this function
+ * is called from the main loop, which installs the file from where it is if its copy is not done yet.
  * @param [in] request The request handle
  * @param [in] path The absolute path to the package to install
  * @param [out] id The ID of the request to the package manager
  * @return 0 on success, otherwise a negative error value.
  * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
  * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @retval #PACKAGE_MANAGER_ERROR_IO_ERROR The package file cannot be copied into the staging directory
  * @see package_manager_request_uninstall()
+ * @see package_manager_request_set_staging_dir()
 */
 int package_manager_request_install(package_manager_request_h request,
 				    const char *path, int *id);
@@ -204,6 +335,506 @@ int package_manager_request_install(package_manager_request_h request,
 int package_manager_request_uninstall(package_manager_request_h request,
 				      const char *name, int *id);
 
+/**
+ * @brief Gets the information of the package archive at the given path without extracting it.
+ *
+ * @details Only the archive index and the package manifest are read, so this is cheap even for large packages.
+ * Web (wgt), native (tpk) and rpm packages are recognized.
+ * @remarks The @a info must be released with package_manager_archive_info_destroy() by you. \n
+ * When no type is set with package_manager_request_set_type(), package_manager_request_install()
+ * detects the type of the package the same way.
+ * @param [in] path The absolute path to the package archive
+ * @param [out] info The archive information handle
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @retval #PACKAGE_MANAGER_ERROR_IO_ERROR The file cannot be read or is not a package archive
+ * @see package_manager_archive_info_destroy()
+*/
+int package_manager_get_archive_info(const char *path,
+				     package_manager_archive_info_h *info);
+
+/**
+ * @brief Destroys the archive information handle.
+ *
+ * @param [in] info The archive information handle
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @see package_manager_get_archive_info()
+*/
+int package_manager_archive_info_destroy(package_manager_archive_info_h info);
+
+/**
+ * @brief Gets the type of the package.
+ *
+ * @remarks The @a type must be released with free() by you.
+ * @param [in] info The archive information handle
+ * @param [out] type The type of the package, such as "wgt", "tpk" or "rpm"
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+*/
+int package_manager_archive_info_get_type(package_manager_archive_info_h info,
+					  char **type);
+
+/**
+ * @brief Gets the name of the package.
+ *
+ * @remarks The @a package must be released with free() by you.
+ * @param [in] info The archive information handle
+ * @param [out] package The name of the package
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+*/
+int package_manager_archive_info_get_package(package_manager_archive_info_h info,
+					     char **package);
+
+/**
+ * @brief Gets the version of the package.
+ *
+ * @remarks The @a version must be released with free() by you. It is NULL if the manifest declares no version.
+ * @param [in] info The archive information handle
+ * @param [out] version The version of the package
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+*/
+int package_manager_archive_info_get_version(package_manager_archive_info_h info,
+					     char **version);
+
+/**
+ * @brief Gets the size of the package once installed, in bytes.
+ *
+ * @remarks This is the total uncompressed size of the archive entries, or the size declared by rpm packages.
+ * @param [in] info The archive information handle
+ * @param [out] size The size of the package
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+*/
+int package_manager_archive_info_get_size(package_manager_archive_info_h info,
+					  unsigned long long *size);
+
+/**
+ * @brief Called for each package the archived package depends on.
+ *
+ * @param [in] package The name of the required package
+ * @param [in] user_data The user data passed from package_manager_archive_info_foreach_dependency()
+ * @return @c true to continue with the next dependency, otherwise @c false to break out of the loop.
+ * @see package_manager_archive_info_foreach_dependency()
+ */
+typedef bool (*package_manager_archive_dependency_cb) (
+			const char *package,
+			void *user_data);
+
+/**
+ * @brief Retrieves the packages the archived package requires, as declared by its manifest.
+ *
+ * @param [in] info The archive information handle
+ * @param [in] callback The callback function to invoke
+ * @param [in] user_data The user data to be passed to the callback function
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+*/
+int package_manager_archive_info_foreach_dependency(package_manager_archive_info_h info,
+						    package_manager_archive_dependency_cb callback,
+						    void *user_data);
+
+/**
+ * @brief Called when the request behind the future has finished.
+ *
+ * @remarks The callback is invoked from the main loop, after the package manager event which finished
+ * the request has been handled, so it may destroy the request handle.
+ * @param [in] future The future handle
+ * @param [in] user_data The user data passed from package_manager_future_set_completed_cb()
+ * @see package_manager_future_set_completed_cb()
+ */
+typedef void (*package_manager_future_completed_cb) (
+			package_manager_future_h future,
+			void *user_data);
+
+/**
+ * @brief Installs the package which is located at the given path, and returns a future completed when the request finishes.
+ *
+ * @remarks The @a future must be released with package_manager_future_destroy() by you. \n
+ * The callback registered with package_manager_request_set_event_cb() is still invoked. \n
+ * This function may be called from any thread: the request is submitted from the main loop,
+ * which this function waits for unless it is called from it or no thread runs it.
+ * @param [in] request The request handle
+ * @param [in] path The absolute path to the package to install
+ * @param [out] future A future handle to be newly created on success
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @see package_manager_request_uninstall_async()
+ * @see package_manager_future_wait()
+*/
+int package_manager_request_install_async(package_manager_request_h request,
+					  const char *path,
+					  package_manager_future_h *future);
+
+/**
+ * @brief Uninstalls the package with the given name, and returns a future completed when the request finishes.
+ *
+ * @remarks The @a future must be released with package_manager_future_destroy() by you. \n
+ * The callback registered with package_manager_request_set_event_cb() is still invoked. \n
+ * This function may be called from any thread: the request is submitted from the main loop,
+ * which this function waits for unless it is called from it or no thread runs it.
+ * @param [in] request The request handle
+ * @param [in] name The name of the package to uninstall
+ * @param [out] future A future handle to be newly created on success
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @see package_manager_request_install_async()
+ * @see package_manager_future_wait()
+*/
+int package_manager_request_uninstall_async(package_manager_request_h request,
+					    const char *name,
+					    package_manager_future_h *future);
+
+/**
+ * @brief Gets the ID of the request behind the future.
+ *
+ * @remarks The ID is -1 while the package file is still being copied into the staging directory.
+ * @param [in] future The future handle
+ * @param [out] id The ID of the request to the package manager
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+*/
+int package_manager_future_get_id(package_manager_future_h future, int *id);
+
+/**
+ * @brief Gets the state of the request behind the future.
+ *
+ * @param [in] future The future handle
+ * @param [out] ready @c true if the request has finished, otherwise @c false
+ * @param [out] event_state #PACAKGE_MANAGER_EVENT_STATE_COMPLETED or #PACAKGE_MANAGER_EVENT_STATE_FAILED once finished
+ * @param [out] error The error code when the request failed
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+*/
+int package_manager_future_get_result(package_manager_future_h future,
+				      bool *ready,
+				      package_manager_event_state_e *event_state,
+				      package_manager_error_e *error);
+
+/**
+ * @brief Registers a callback function to be invoked once the request behind the future has finished.
+ *
+ * @remarks If the request has already finished, @a callback is invoked from the main loop shortly after. \n
+ * Only one callback can be registered per future.
+ * @param [in] future The future handle
+ * @param [in] callback The callback function to register
+ * @param [in] user_data The user data to be passed to the callback function
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @post package_manager_future_completed_cb() will be invoked.
+ * @see package_manager_future_completed_cb()
+*/
+int package_manager_future_set_completed_cb(package_manager_future_h future,
+					    package_manager_future_completed_cb callback,
+					    void *user_data);
+
+/**
+ * @brief Blocks until the request behind the future has finished.
+ *
+ * @remarks This function must not be called from the thread dispatching the package manager events.
+ * @param [in] future The future handle
+ * @param [in] timeout The maximum time to wait in milliseconds, or -1 to wait forever
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_TIMED_OUT The request has not finished in time
+ * @see package_manager_future_wait_all()
+*/
+int package_manager_future_wait(package_manager_future_h future, int timeout);
+
+/**
+ * @brief Blocks until the requests behind all the futures have finished.
+ *
+ * @remarks The calling thread is woken up once, when the last request finishes. \n
+ * This function must not be called from the thread dispatching the package manager events, \n
+ * and a future can only be waited for by one thread at a time.
+ * @param [in] futures The array of future handles
+ * @param [in] count The number of future handles in @a futures
+ * @param [in] timeout The maximum time to wait in milliseconds, or -1 to wait forever
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_TIMED_OUT Some requests have not finished in time
+ * @see package_manager_future_wait()
+*/
+int package_manager_future_wait_all(package_manager_future_h *futures,
+				    int count, int timeout);
+
+/**
+ * @brief Destroys the future handle.
+ *
+ * @remarks The request itself is not cancelled. \n
+ * If the completion callback is running on another thread, this function waits for it to return,
+ * so its user data may be released afterwards. It may also be called from the callback itself.
+ * @param [in] future The future handle
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+*/
+int package_manager_future_destroy(package_manager_future_h future);
+
+/**
+ * @brief Called when the aggregated progress of the transaction changes, and once when all of its operations have finished.
+ *
+ * @param [in] transaction The transaction handle
+ * @param [in] event_state #PACAKGE_MANAGER_EVENT_STATE_PROCESSING while operations are running, \n
+ * #PACAKGE_MANAGER_EVENT_STATE_COMPLETED if every operation completed, \n
+ * #PACAKGE_MANAGER_EVENT_STATE_FAILED if any operation failed
+ * @param [in] progress The progress of the whole transaction \n
+ * The range of progress is from 0 to 100.
+ * @param [in] user_data The user data passed from package_manager_transaction_commit()
+ * @see package_manager_transaction_commit()
+ * @see package_manager_transaction_foreach_member()
+ */
+typedef void (*package_manager_transaction_event_cb) (
+			package_manager_transaction_h transaction,
+			package_manager_event_state_e event_state,
+			int progress,
+			void *user_data);
+
+/**
+ * @brief Called for each operation of the transaction.
+ *
+ * @param [in] id The ID of the request to the package manager, or -1 if the operation could not be submitted
+ * @param [in] package The name of the package if known, otherwise the path or name passed when the operation was added
+ * @param [in] event_type The type of the operation
+ * @param [in] event_state The current state of the operation
+ * @param [in] error The error code when the operation failed
+ * @param [in] user_data The user data passed from package_manager_transaction_foreach_member()
+ * @return @c true to continue with the next operation, \n @c false to stop the iteration
+ * @see package_manager_transaction_foreach_member()
+ */
+typedef bool (*package_manager_transaction_member_cb) (
+			int id,
+			const char *package,
+			package_manager_event_type_e event_type,
+			package_manager_event_state_e event_state,
+			package_manager_error_e error,
+			void *user_data);
+
+/**
+ * @brief Begins a transaction grouping several package operations on the request handle.
+ *
+ * @remarks The @a transaction must be released with package_manager_transaction_destroy() by you. \n
+ * The type and mode set on the @a request apply to every operation of the transaction.
+ * @param [in] request The request handle
+ * @param [out] transaction A transaction handle to be newly created on success
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @see package_manager_transaction_commit()
+ * @see package_manager_transaction_destroy()
+ */
+int package_manager_transaction_begin(package_manager_request_h request,
+				      package_manager_transaction_h *transaction);
+
+/**
+ * @brief Adds the installation of the package which is located at the given path to the transaction.
+ *
+ * @param [in] transaction The transaction handle
+ * @param [in] path The absolute path to the package to install
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @pre package_manager_transaction_commit() has not been called.
+ */
+int package_manager_transaction_add_install(package_manager_transaction_h transaction,
+					    const char *path);
+
+/**
+ * @brief Adds the uninstallation of the package with the given name to the transaction.
+ *
+ * @param [in] transaction The transaction handle
+ * @param [in] name The name of the package to uninstall
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @pre package_manager_transaction_commit() has not been called.
+ */
+int package_manager_transaction_add_uninstall(package_manager_transaction_h transaction,
+					      const char *name);
+
+/**
+ * @brief Submits all the operations of the transaction to the package manager.
+ *
+ * @remarks If some operations cannot be submitted, they are reported as failed
+ * and the transaction goes on with the others. \n
+ * With a staging directory, each package is submitted as soon as its own copy is done. \n
+ * If no operation could be submitted, the error of the first one is returned.
+ * @param [in] transaction The transaction handle
+ * @param [in] callback The callback function to be invoked with the progress of the transaction
+ * @param [in] user_data The user data to be passed to the callback function
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter, or the first operation could not be submitted
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @retval #PACKAGE_MANAGER_ERROR_IO_ERROR The first operation could not be submitted, or the main loop is stopping
+ * @post package_manager_transaction_event_cb() will be invoked.
+ * @see package_manager_transaction_event_cb()
+ */
+int package_manager_transaction_commit(package_manager_transaction_h transaction,
+				       package_manager_transaction_event_cb callback,
+				       void *user_data);
+
+/**
+ * @brief Retrieves the outcome of every operation of the transaction.
+ *
+ * @param [in] transaction The transaction handle
+ * @param [in] callback The callback function to invoke
+ * @param [in] user_data The user data to be passed to the callback function
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @post This function invokes package_manager_transaction_member_cb() repeatedly for each operation.
+ * @see package_manager_transaction_member_cb()
+ */
+int package_manager_transaction_foreach_member(package_manager_transaction_h transaction,
+					       package_manager_transaction_member_cb callback,
+					       void *user_data);
+
+/**
+ * @brief Destroys the transaction handle.
+ *
+ * @remarks Operations already submitted keep running, but are no longer reported. \n
+ * The transaction may be destroyed before or after the request handle it was begun on.
+ * @param [in] transaction The transaction handle
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @see package_manager_transaction_begin()
+ */
+int package_manager_transaction_destroy(package_manager_transaction_h transaction);
+
+/**
+ * @brief Called when a package of the installation plan is submitted or finishes, and once when the whole plan has finished.
+ *
+ * @param [in] plan The installation plan handle
+ * @param [in] package The name of the package, or NULL when the whole plan has finished
+ * @param [in] event_state #PACAKGE_MANAGER_EVENT_STATE_STARTED when the package is submitted, \n
+ * #PACAKGE_MANAGER_EVENT_STATE_COMPLETED or #PACAKGE_MANAGER_EVENT_STATE_FAILED when it finishes. \n
+ * For the whole plan, #PACAKGE_MANAGER_EVENT_STATE_COMPLETED if every package was installed, otherwise #PACAKGE_MANAGER_EVENT_STATE_FAILED.
+ * @param [in] error The error code when the package failed, #PACKAGE_MANAGER_ERROR_CANCELED if one of the packages it depends on failed
+ * @param [in] user_data The user data passed from package_manager_plan_execute()
+ * @see package_manager_plan_execute()
+ */
+typedef void (*package_manager_plan_event_cb) (
+			package_manager_plan_h plan,
+			const char *package,
+			package_manager_event_state_e event_state,
+			package_manager_error_e error,
+			void *user_data);
+
+/**
+ * @brief Creates an installation plan for a set of packages depending on each other.
+ *
+ * @details Packages whose dependencies are satisfied are installed concurrently, and each
+ * package is submitted as soon as all the packages it depends on have been installed.
+ * @remarks The @a plan must be released with package_manager_plan_destroy() by you. \n
+ * The type and mode set on the @a request apply to every package of the plan.
+ * @param [in] request The request handle
+ * @param [out] plan An installation plan handle to be newly created on success
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @see package_manager_plan_destroy()
+ */
+int package_manager_plan_create(package_manager_request_h request,
+				package_manager_plan_h *plan);
+
+/**
+ * @brief Adds the package which is located at the given path to the installation plan.
+ *
+ * @remarks The name of the package and the packages it requires are read from its manifest. \n
+ * Required packages which are not part of the plan are assumed to be installed already.
+ * @param [in] plan The installation plan handle
+ * @param [in] path The absolute path to the package to install
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter, or the package is already part of the plan
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @retval #PACKAGE_MANAGER_ERROR_IO_ERROR The file is not a package archive
+ * @pre package_manager_plan_execute() has not been called.
+ * @see package_manager_get_archive_info()
+ */
+int package_manager_plan_add_package(package_manager_plan_h plan,
+				     const char *path);
+
+/**
+ * @brief Declares that a package of the installation plan requires another package, in addition to what its manifest declares.
+ *
+ * @param [in] plan The installation plan handle
+ * @param [in] package The name of a package added to the plan
+ * @param [in] required The name of the package it requires
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter, or @a package is not part of the plan
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @pre package_manager_plan_execute() has not been called.
+ */
+int package_manager_plan_add_dependency(package_manager_plan_h plan,
+					const char *package,
+					const char *required);
+
+/**
+ * @brief Starts installing the packages of the plan.
+ *
+ * @remarks If a package fails, the packages depending on it are canceled right away
+ * while the others go on. \n
+ * Packages which cannot be submitted are reported as failed. \n
+ * With a staging directory, all the packages start being copied right away, and a package is only
+ * submitted once its copy is done. The copies are made in the background, the main loop never waits for them.
+ * @param [in] plan The installation plan handle
+ * @param [in] max_parallel The maximum number of packages being installed at the same time, or 0 for no limit
+ * @param [in] callback The callback function to be invoked as the packages progress
+ * @param [in] user_data The user data to be passed to the callback function
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter, the plan is empty or its dependencies form a cycle
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @post package_manager_plan_event_cb() will be invoked.
+ */
+int package_manager_plan_execute(package_manager_plan_h plan, int max_parallel,
+				 package_manager_plan_event_cb callback,
+				 void *user_data);
+
+/**
+ * @brief Destroys the installation plan handle.
+ *
+ * @remarks Packages already submitted keep being installed, but are no longer reported. \n
+ * The plan may be destroyed before or after the request handle it was created with. \n
+ * It may also be destroyed from package_manager_plan_event_cb(), for example to give up after a failure.
+ * @param [in] plan The installation plan handle
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @see package_manager_plan_create()
+ */
+int package_manager_plan_destroy(package_manager_plan_h plan);
+
 /**
  * @brief Called when the package is installed, uninstalled or updated, and the progress of the request to the package manager changes.
  *
@@ -244,10 +875,11 @@ int package_manager_create(package_manager_h * manager);
 /**
  * @brief Destroys the package manager handle.
  *
+ * @remarks In #PACKAGE_MANAGER_DISPATCH_MODE_PARALLEL mode, the handle cannot be destroyed from its own callback.
  * @param [in] manager The package manager handle
  * @return 0 on success, otherwise a negative error value.
  * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
- * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter, or called from the callback of a handle in parallel mode
  * @see package_manager_create()
  */
 int package_manager_destroy(package_manager_h manager);
@@ -281,6 +913,250 @@ int package_manager_set_event_cb(package_manager_h manager,
 */
 int package_manager_unset_event_cb(package_manager_h manager);
 
+/**
+ * @brief Sets how the callback registered with package_manager_set_event_cb() is invoked.
+ *
+ * @remarks In #PACKAGE_MANAGER_DISPATCH_MODE_PARALLEL mode the events of each package are
+ * still delivered strictly in order, one at a time, while events of different packages
+ * are delivered concurrently from a pool of worker threads. The callback must then be thread-safe. \n
+ * Switching back to #PACKAGE_MANAGER_DISPATCH_MODE_SERIAL waits for the queued events to be delivered,
+ * so the mode of a handle in parallel mode cannot be changed from its own callback. \n
+ * Requests submitted from the callback while the workers are being stopped, which would wait for
+ * the main loop, fail with #PACKAGE_MANAGER_ERROR_IO_ERROR instead.
+ * @param [in] manager The package manager handle
+ * @param [in] mode The dispatch mode
+ * @param [in] threads The number of worker threads in parallel mode, or 0 for one per online CPU
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter, or called from the callback of the handle in parallel mode
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @retval #PACKAGE_MANAGER_ERROR_IO_ERROR Internal I/O error
+ * @see package_manager_set_event_cb()
+*/
+int package_manager_set_dispatch_mode(package_manager_h manager,
+				      package_manager_dispatch_mode_e mode,
+				      int threads);
+
+/**
+ * @brief Sets where the package manager handle gets its package events from.
+ *
+ * @details Every listening handle normally receives and decodes each package event itself.
+ * With #PACKAGE_MANAGER_EVENT_BUS_PUBLISH, the handle also publishes the decoded events into
+ * a shared memory ring, which handles of other processes set to #PACKAGE_MANAGER_EVENT_BUS_ATTACH
+ * read instead of listening themselves. Only one process publishes at a time,
+ * and only to processes of the same user or root, at most 64 of them.
+ * @remarks The mode must be set before the handle starts listening, that is before
+ * package_manager_set_event_cb() or package_manager_set_storage_cb(). \n
+ * An attached handle falls back to listening directly when there is no publisher,
+ * or when the publisher goes away. Events sent while it falls back may be missed.
+ * @param [in] manager The package manager handle
+ * @param [in] mode The event bus mode
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter, or the handle is already listening
+ * @see package_manager_set_event_cb()
+*/
+int package_manager_set_event_bus(package_manager_h manager,
+				  package_manager_event_bus_e mode);
+
+/**
+ * @brief Called when the storage used by a package crosses the threshold.
+ *
+ * @param [in] package The name of the package
+ * @param [in] size The storage currently used by the package, in bytes
+ * @param [in] exceeded @c true if the size rose above the threshold, \n
+ * @c false if it dropped back below it
+ * @param [in] user_data The user data passed from package_manager_set_storage_cb()
+ * @see package_manager_set_storage_cb()
+ * @see package_manager_unset_storage_cb()
+ */
+typedef void (*package_manager_storage_cb) (
+			const char *package,
+			unsigned long long size,
+			bool exceeded,
+			void *user_data);
+
+/**
+ * @brief Starts keeping running totals of the storage used by the installed packages.
+ *
+ * @remarks The package data directories are scanned once, after which the totals are
+ * updated incrementally from file system notifications and from the install, uninstall
+ * and update events of the package manager. \n
+ * Files being written are accounted for when they are closed.
+ * @param [in] manager The package manager handle
+ * @param [in] threshold The per-package size in bytes at which @a callback is invoked, \n
+ * or 0 to only keep the totals
+ * @param [in] callback The callback function to register, may be @c NULL
+ * @param [in] user_data The user data to be passed to the callback function
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @retval #PACKAGE_MANAGER_ERROR_IO_ERROR Internal I/O error
+ * @post package_manager_storage_cb() will be invoked.
+ * @see package_manager_storage_cb()
+ * @see package_manager_unset_storage_cb()
+ * @see package_manager_get_package_storage_size()
+ * @see package_manager_get_total_storage_size()
+*/
+int package_manager_set_storage_cb(package_manager_h manager,
+				   unsigned long long threshold,
+				   package_manager_storage_cb callback,
+				   void *user_data);
+
+/**
+ * @brief Stops keeping the storage totals and unregisters the callback function.
+ *
+ * @param [in] manager The package manager handle
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @see package_manager_storage_cb()
+ * @see package_manager_set_storage_cb()
+*/
+int package_manager_unset_storage_cb(package_manager_h manager);
+
+/**
+ * @brief Gets the storage used by the package.
+ *
+ * @param [in] manager The package manager handle
+ * @param [in] package The name of the package
+ * @param [out] size The storage used by the package, in bytes
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @pre package_manager_set_storage_cb() has been called.
+ * @see package_manager_set_storage_cb()
+*/
+int package_manager_get_package_storage_size(package_manager_h manager,
+					     const char *package,
+					     unsigned long long *size);
+
+/**
+ * @brief Gets the storage used by all the installed packages.
+ *
+ * @param [in] manager The package manager handle
+ * @param [out] size The storage used by all the packages, in bytes
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @pre package_manager_set_storage_cb() has been called.
+ * @see package_manager_set_storage_cb()
+*/
+int package_manager_get_total_storage_size(package_manager_h manager,
+					   unsigned long long *size);
+
+/**
+ * @brief Called for each package event retrieved from the event journal.
+ *
+ * @param [in] seq The sequence number of the event, increasing by one for each recorded event
+ * @param [in] type The type of the package
+ * @param [in] package The name of the package
+ * @param [in] event_type The type of the request to the package manager
+ * @param [in] event_state #PACAKGE_MANAGER_EVENT_STATE_COMPLETED or #PACAKGE_MANAGER_EVENT_STATE_FAILED
+ * @param [in] error The error code when the package manager failed to process the request
+ * @param [in] user_data The user data passed from package_manager_get_events_since()
+ * @return @c true to continue with the next event, \n @c false to stop the iteration
+ * @see package_manager_get_events_since()
+ */
+typedef bool (*package_manager_journal_event_cb) (
+			unsigned int seq,
+			const char *type,
+			const char *package,
+			package_manager_event_type_e event_type,
+			package_manager_event_state_e event_state,
+			package_manager_error_e error,
+			void *user_data);
+
+/**
+ * @brief Retrieves the completed and failed package events recorded after the given sequence number.
+ *
+ * @remarks Events are recorded while at least one package manager handle of the process listens
+ * to the package manager. Only the most recent events are kept; if events older than
+ * the oldest recorded one are requested, the iteration starts at the oldest one and the
+ * gap is visible in the sequence numbers.
+ * @param [in] seq The sequence number of the last event already seen, or 0 to get all the recorded events
+ * @param [in] callback The callback function to invoke
+ * @param [in] user_data The user data to be passed to the callback function
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @post This function invokes package_manager_journal_event_cb() repeatedly for each event.
+ * @see package_manager_journal_event_cb()
+ * @see package_manager_get_event_seq()
+ */
+int package_manager_get_events_since(unsigned int seq,
+				     package_manager_journal_event_cb callback,
+				     void *user_data);
+
+/**
+ * @brief Gets the sequence number of the most recently recorded package event.
+ *
+ * @param [out] seq The sequence number of the last event, or 0 if none was recorded
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @see package_manager_get_events_since()
+ */
+int package_manager_get_event_seq(unsigned int *seq);
+
+/**
+ * @brief Called for each package added, removed or updated since a package set generation.
+ *
+ * @param [in] type The type of the package
+ * @param [in] package The name of the package
+ * @param [in] change How the package changed
+ * @param [in] user_data The user data passed from package_manager_get_changes()
+ * @return @c true to continue with the next package, \n @c false to stop the iteration
+ * @see package_manager_get_changes()
+ */
+typedef bool (*package_manager_change_cb) (
+			const char *type,
+			const char *package,
+			package_manager_change_e change,
+			void *user_data);
+
+/**
+ * @brief Gets the current package set generation.
+ *
+ * @remarks The generation is bumped each time an install, uninstall or update completes,
+ * as recorded in the event journal. \n
+ * Generations are counted from 0 in each process, so they only have a meaning within
+ * the process which got them.
+ * @param [out] generation The current generation
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @see package_manager_get_changes()
+ */
+int package_manager_get_generation(unsigned int *generation);
+
+/**
+ * @brief Retrieves the packages added, removed or updated since the given package set generation.
+ *
+ * @remarks Several changes of the same package are folded into one. \n
+ * If the changes since @a since_generation are no longer recorded, @a callback is not
+ * invoked and @a resync is set to @c true; the caller must then enumerate all the packages again.
+ * This is also the case if @a since_generation is ahead of the current generation, e.g. when it
+ * was kept from an earlier run of the process.
+ * @param [in] since_generation The generation the caller is in sync with
+ * @param [in] callback The callback function to invoke
+ * @param [in] user_data The user data to be passed to the callback function
+ * @param [out] generation The generation the caller is in sync with afterwards
+ * @param [out] resync @c true if a full resync is required, otherwise @c false
+ * @return 0 on success, otherwise a negative error value.
+ * @retval #PACKAGE_MANAGER_ERROR_NONE Successful
+ * @retval #PACKAGE_MANAGER_ERROR_INVALID_PARAMETER Invalid parameter
+ * @retval #PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY Out of memory
+ * @post This function invokes package_manager_change_cb() repeatedly for each changed package.
+ * @see package_manager_change_cb()
+ * @see package_manager_get_generation()
+ */
+int package_manager_get_changes(unsigned int since_generation,
+				package_manager_change_cb callback,
+				void *user_data, unsigned int *generation,
+				bool *resync);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,686 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __TIZEN_APPFW_PACKAGE_MANAGER_HPP
+#define __TIZEN_APPFW_PACKAGE_MANAGER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#include <coroutine>
+#define PACKAGE_MANAGER_HAS_COROUTINE 1
+#endif
+
+#include <package_manager.h>
+
+/**
+ * @addtogroup CAPI_PACKAGE_MANAGER_MODULE
+ * @{
+ */
+
+/**
+ * @brief C++ bindings of the package manager API (C++17).
+ *
+ * The handles are move-only and released on destruction. Request callbacks
+ * are stored inline in the handle objects, while a manager keeps its callback
+ * in a single heap allocation made when it is created, as events may still be
+ * queued for it when the manager is moved. Dispatching an event needs no
+ * further allocation and no user_data trampoline on the caller side.
+ * The strings of an event only live for the duration of the callback.
+ */
+namespace package_manager {
+
+/**
+ * @brief Error codes of the package manager, usable as std::error_code
+ */
+enum class error : int {
+	none = PACKAGE_MANAGER_ERROR_NONE,
+	invalid_parameter = PACKAGE_MANAGER_ERROR_INVALID_PARAMETER,
+	out_of_memory = PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY,
+	io_error = PACKAGE_MANAGER_ERROR_IO_ERROR,
+	timed_out = PACKAGE_MANAGER_ERROR_TIMED_OUT,
+	canceled = PACKAGE_MANAGER_ERROR_CANCELED,
+};
+
+/**
+ * @brief Type of the request to the package manager
+ */
+enum class event_type : int {
+	install = PACAKGE_MANAGER_EVENT_TYPE_INSTALL,
+	uninstall = PACAKGE_MANAGER_EVENT_TYPE_UNINSTALL,
+	update = PACAKGE_MANAGER_EVENT_TYPE_UPDATE,
+};
+
+/**
+ * @brief State of the request to the package manager
+ */
+enum class event_state : int {
+	started = PACAKGE_MANAGER_EVENT_STATE_STARTED,
+	processing = PACAKGE_MANAGER_EVENT_STATE_PROCESSING,
+	completed = PACAKGE_MANAGER_EVENT_STATE_COMPLETED,
+	failed = PACAKGE_MANAGER_EVENT_STATE_FAILED,
+};
+
+/**
+ * @brief Mode of the request
+ */
+enum class request_mode : int {
+	normal = PACAKGE_MANAGER_REQUEST_MODE_DEFAULT,
+	quiet = PACAKGE_MANAGER_REQUEST_MODE_QUIET,
+};
+
+namespace detail {
+
+class error_category_impl : public std::error_category {
+public:
+	const char *name() const noexcept override
+	{
+		return "package_manager";
+	}
+
+	std::string message(int value) const override
+	{
+		switch (static_cast<error>(value)) {
+		case error::none:
+			return "Successful";
+		case error::invalid_parameter:
+			return "Invalid parameter";
+		case error::out_of_memory:
+			return "Out of memory";
+		case error::io_error:
+			return "Internal I/O error";
+		case error::timed_out:
+			return "Time out";
+		case error::canceled:
+			return "Operation canceled";
+		}
+		return "Unknown error";
+	}
+};
+
+inline std::string_view to_string_view(const char *str) noexcept
+{
+	return str ? std::string_view(str) : std::string_view();
+}
+
+} /* namespace detail */
+
+/**
+ * @brief Returns the error category of the package manager.
+ */
+inline const std::error_category &error_category() noexcept
+{
+	static const detail::error_category_impl category;
+	return category;
+}
+
+inline std::error_code make_error_code(error e) noexcept
+{
+	return std::error_code(static_cast<int>(e), error_category());
+}
+
+inline std::error_code make_error_code(int ret) noexcept
+{
+	return make_error_code(static_cast<error>(ret));
+}
+
+/**
+ * @brief Event passed to the callback of a request handle
+ */
+struct request_event {
+	int id;
+	std::string_view package_type;
+	std::string_view package;
+	event_type type;
+	event_state state;
+	int progress;
+	std::error_code error;
+};
+
+/**
+ * @brief Event passed to the callback of a package manager handle
+ */
+struct package_event {
+	std::string_view package_type;
+	std::string_view package;
+	event_type type;
+	event_state state;
+	int progress;
+	std::error_code error;
+};
+
+/**
+ * @brief Move-only owner of a package_manager_request_h with an inline callback.
+ *
+ * @a Callback is any function object invocable with a const request_event &.
+ */
+template <typename Callback>
+class basic_request {
+public:
+	basic_request(Callback callback, std::error_code &ec) noexcept(
+		std::is_nothrow_move_constructible_v<Callback>)
+		: callback_(std::move(callback))
+	{
+		ec = make_error_code(package_manager_request_create(&handle_));
+		if (!ec)
+			ec = attach();
+	}
+
+	explicit basic_request(Callback callback)
+		: callback_(std::move(callback))
+	{
+		std::error_code ec =
+			make_error_code(package_manager_request_create(&handle_));
+		if (!ec)
+			ec = attach();
+		if (ec) {
+			reset();
+			throw std::system_error(ec, "package_manager_request_create");
+		}
+	}
+
+	basic_request(basic_request &&other) noexcept(
+		std::is_nothrow_move_constructible_v<Callback>)
+		: handle_(std::exchange(other.handle_, nullptr)),
+		  callback_(std::move(other.callback_))
+	{
+		attach();
+	}
+
+	basic_request &operator=(basic_request &&other) noexcept(
+		std::is_nothrow_move_assignable_v<Callback>)
+	{
+		if (this != &other) {
+			reset();
+			handle_ = std::exchange(other.handle_, nullptr);
+			callback_ = std::move(other.callback_);
+			attach();
+		}
+		return *this;
+	}
+
+	basic_request(const basic_request &) = delete;
+	basic_request &operator=(const basic_request &) = delete;
+
+	~basic_request()
+	{
+		reset();
+	}
+
+	package_manager_request_h native_handle() const noexcept
+	{
+		return handle_;
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return handle_ != nullptr;
+	}
+
+	/**
+	 * @remarks The @a type is not copied and must stay valid while the handle is used.
+	 */
+	std::error_code set_type(const char *type) noexcept
+	{
+		return make_error_code(package_manager_request_set_type(handle_, type));
+	}
+
+	std::error_code set_mode(request_mode mode) noexcept
+	{
+		return make_error_code(package_manager_request_set_mode(handle_,
+				static_cast<package_manager_request_mode_e>(mode)));
+	}
+
+	std::error_code set_timeout(std::chrono::milliseconds timeout) noexcept
+	{
+		return make_error_code(package_manager_request_set_timeout(handle_,
+				static_cast<int>(timeout.count())));
+	}
+
+	std::error_code set_timeout(int id, std::chrono::milliseconds timeout) noexcept
+	{
+		return make_error_code(package_manager_request_set_request_timeout(
+				handle_, id, static_cast<int>(timeout.count())));
+	}
+
+	std::error_code set_staging_dir(const char *dir) noexcept
+	{
+		return make_error_code(package_manager_request_set_staging_dir(handle_, dir));
+	}
+
+	std::error_code stage(const char *path) noexcept
+	{
+		return make_error_code(package_manager_request_stage(handle_, path));
+	}
+
+	std::error_code install(const char *path, int &id) noexcept
+	{
+		return make_error_code(package_manager_request_install(handle_, path, &id));
+	}
+
+	std::error_code uninstall(const char *name, int &id) noexcept
+	{
+		return make_error_code(package_manager_request_uninstall(handle_, name, &id));
+	}
+
+	Callback &callback() noexcept
+	{
+		return callback_;
+	}
+
+private:
+	static void dispatch(int id, const char *pkg_type, const char *pkg_name,
+			     package_manager_event_type_e type,
+			     package_manager_event_state_e state,
+			     int progress, package_manager_error_e err,
+			     void *user_data)
+	{
+		auto *self = static_cast<basic_request *>(user_data);
+
+		self->callback_(request_event{
+			id, detail::to_string_view(pkg_type),
+			detail::to_string_view(pkg_name),
+			static_cast<event_type>(type),
+			static_cast<event_state>(state), progress,
+			make_error_code(err)});
+	}
+
+	std::error_code attach() noexcept
+	{
+		if (handle_ == nullptr)
+			return make_error_code(error::invalid_parameter);
+		return make_error_code(package_manager_request_set_event_cb(
+				handle_, &basic_request::dispatch, this));
+	}
+
+	void reset() noexcept
+	{
+		if (handle_) {
+			package_manager_reqeust_destroy(handle_);
+			handle_ = nullptr;
+		}
+	}
+
+	package_manager_request_h handle_ = nullptr;
+	Callback callback_;
+};
+
+/**
+ * @brief Move-only owner of a package_manager_h with an inline callback.
+ *
+ * @a Callback is any function object invocable with a const package_event &.
+ * It is kept on the heap, so that events already queued for the callback,
+ * e.g. by the parallel dispatcher, still reach it after a move.
+ */
+template <typename Callback>
+class basic_manager {
+public:
+	basic_manager(Callback callback, std::error_code &ec) noexcept(
+		std::is_nothrow_move_constructible_v<Callback>)
+		: callback_(new (std::nothrow) Callback(std::move(callback)))
+	{
+		if (!callback_) {
+			ec = make_error_code(error::out_of_memory);
+			return;
+		}
+		ec = make_error_code(package_manager_create(&handle_));
+		if (!ec)
+			ec = attach();
+	}
+
+	explicit basic_manager(Callback callback)
+		: callback_(std::make_unique<Callback>(std::move(callback)))
+	{
+		std::error_code ec = make_error_code(package_manager_create(&handle_));
+		if (!ec)
+			ec = attach();
+		if (ec) {
+			reset();
+			throw std::system_error(ec, "package_manager_create");
+		}
+	}
+
+	basic_manager(basic_manager &&other) noexcept
+		: handle_(std::exchange(other.handle_, nullptr)),
+		  callback_(std::move(other.callback_))
+	{
+	}
+
+	basic_manager &operator=(basic_manager &&other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			handle_ = std::exchange(other.handle_, nullptr);
+			callback_ = std::move(other.callback_);
+		}
+		return *this;
+	}
+
+	basic_manager(const basic_manager &) = delete;
+	basic_manager &operator=(const basic_manager &) = delete;
+
+	~basic_manager()
+	{
+		reset();
+	}
+
+	package_manager_h native_handle() const noexcept
+	{
+		return handle_;
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return handle_ != nullptr;
+	}
+
+	/**
+	 * @remarks Must not be called on a moved-from object.
+	 */
+	Callback &callback() noexcept
+	{
+		return *callback_;
+	}
+
+private:
+	static void dispatch(const char *pkg_type, const char *pkg_name,
+			     package_manager_event_type_e type,
+			     package_manager_event_state_e state,
+			     int progress, package_manager_error_e err,
+			     void *user_data)
+	{
+		auto *callback = static_cast<Callback *>(user_data);
+
+		(*callback)(package_event{
+			detail::to_string_view(pkg_type),
+			detail::to_string_view(pkg_name),
+			static_cast<event_type>(type),
+			static_cast<event_state>(state), progress,
+			make_error_code(err)});
+	}
+
+	std::error_code attach() noexcept
+	{
+		if (handle_ == nullptr)
+			return make_error_code(error::invalid_parameter);
+		return make_error_code(package_manager_set_event_cb(
+				handle_, &basic_manager::dispatch, callback_.get()));
+	}
+
+	/* Destroying the handle drains its dispatcher before the callback goes */
+	void reset() noexcept
+	{
+		if (handle_) {
+			package_manager_destroy(handle_);
+			handle_ = nullptr;
+		}
+	}
+
+	package_manager_h handle_ = nullptr;
+	std::unique_ptr<Callback> callback_;
+};
+
+/**
+ * @brief Outcome of a finished request
+ */
+struct result {
+	event_state state;
+	std::error_code error;
+};
+
+/**
+ * @brief Move-only owner of a package_manager_future_h.
+ *
+ * With C++20 a future can be awaited with co_await, which resumes the
+ * coroutine from the thread dispatching the package manager events.
+ */
+class future {
+public:
+	future() noexcept = default;
+
+	explicit future(package_manager_future_h handle) noexcept
+		: handle_(handle)
+	{
+	}
+
+	future(future &&other) noexcept
+		: handle_(std::exchange(other.handle_, nullptr))
+	{
+	}
+
+	future &operator=(future &&other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			handle_ = std::exchange(other.handle_, nullptr);
+		}
+		return *this;
+	}
+
+	future(const future &) = delete;
+	future &operator=(const future &) = delete;
+
+	~future()
+	{
+		reset();
+	}
+
+	package_manager_future_h native_handle() const noexcept
+	{
+		return handle_;
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return handle_ != nullptr;
+	}
+
+	int id() const noexcept
+	{
+		int id = -1;
+		package_manager_future_get_id(handle_, &id);
+		return id;
+	}
+
+	bool ready() const noexcept
+	{
+		bool ready = false;
+		package_manager_future_get_result(handle_, &ready, nullptr, nullptr);
+		return ready;
+	}
+
+	result get() const noexcept
+	{
+		return result_of(handle_);
+	}
+
+	/**
+	 * @remarks Must not be called from the thread dispatching the package manager events.
+	 */
+	std::error_code wait(int timeout = -1) const noexcept
+	{
+		return make_error_code(package_manager_future_wait(handle_, timeout));
+	}
+
+#ifdef PACKAGE_MANAGER_HAS_COROUTINE
+	struct awaiter {
+		package_manager_future_h handle;
+
+		bool await_ready() const noexcept
+		{
+			bool ready = false;
+			package_manager_future_get_result(handle, &ready, nullptr, nullptr);
+			return ready;
+		}
+
+		void await_suspend(std::coroutine_handle<> coroutine) const noexcept
+		{
+			package_manager_future_set_completed_cb(handle, &awaiter::resume,
+					coroutine.address());
+		}
+
+		result await_resume() const noexcept
+		{
+			return future::result_of(handle);
+		}
+
+		static void resume(package_manager_future_h, void *user_data)
+		{
+			std::coroutine_handle<>::from_address(user_data).resume();
+		}
+	};
+
+	awaiter operator co_await() const noexcept
+	{
+		return awaiter{handle_};
+	}
+#endif
+
+	static result result_of(package_manager_future_h handle) noexcept
+	{
+		bool ready = false;
+		package_manager_event_state_e state = PACAKGE_MANAGER_EVENT_STATE_FAILED;
+		package_manager_error_e err = PACKAGE_MANAGER_ERROR_NONE;
+
+		package_manager_future_get_result(handle, &ready, &state, &err);
+		return result{static_cast<event_state>(state), make_error_code(err)};
+	}
+
+private:
+	void reset() noexcept
+	{
+		if (handle_) {
+			package_manager_future_destroy(handle_);
+			handle_ = nullptr;
+		}
+	}
+
+	package_manager_future_h handle_ = nullptr;
+};
+
+inline future install_async(package_manager_request_h request, const char *path,
+			    std::error_code &ec) noexcept
+{
+	package_manager_future_h handle = nullptr;
+
+	ec = make_error_code(package_manager_request_install_async(request, path, &handle));
+	return future(handle);
+}
+
+inline future uninstall_async(package_manager_request_h request, const char *name,
+			      std::error_code &ec) noexcept
+{
+	package_manager_future_h handle = nullptr;
+
+	ec = make_error_code(package_manager_request_uninstall_async(request, name, &handle));
+	return future(handle);
+}
+
+/**
+ * @brief Blocks until all the futures have finished, with a single wakeup.
+ *
+ * @remarks Must not be called from the thread dispatching the package manager events.
+ */
+template <std::size_t N>
+std::error_code wait_all(future (&futures)[N], int timeout = -1) noexcept
+{
+	package_manager_future_h handles[N];
+
+	for (std::size_t i = 0; i < N; i++)
+		handles[i] = futures[i].native_handle();
+	return make_error_code(package_manager_future_wait_all(handles,
+			static_cast<int>(N), timeout));
+}
+
+#ifdef PACKAGE_MANAGER_HAS_COROUTINE
+/**
+ * @brief Awaitable resuming the coroutine once, when the last of the futures has finished.
+ *
+ * @a Range is any range of future objects, e.g. std::vector<future>.
+ * The awaiter lives in the coroutine frame, so awaiting allocates nothing.
+ */
+template <typename Range>
+class when_all {
+public:
+	explicit when_all(Range &futures) noexcept : futures_(futures)
+	{
+	}
+
+	bool await_ready() noexcept
+	{
+		for (auto &f : futures_) {
+			if (!f.ready())
+				return false;
+		}
+		return true;
+	}
+
+	bool await_suspend(std::coroutine_handle<> coroutine) noexcept
+	{
+		coroutine_ = coroutine;
+
+		/* Hold one count while registering, so that no completion resumes early */
+		remaining_.store(1, std::memory_order_relaxed);
+		for (auto &f : futures_) {
+			remaining_.fetch_add(1, std::memory_order_relaxed);
+			package_manager_future_set_completed_cb(f.native_handle(),
+					&when_all::complete, this);
+		}
+
+		return remaining_.fetch_sub(1, std::memory_order_acq_rel) != 1;
+	}
+
+	void await_resume() const noexcept
+	{
+	}
+
+private:
+	static void complete(package_manager_future_h, void *user_data)
+	{
+		auto *self = static_cast<when_all *>(user_data);
+
+		if (self->remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			self->coroutine_.resume();
+	}
+
+	Range &futures_;
+	std::atomic<std::size_t> remaining_{0};
+	std::coroutine_handle<> coroutine_;
+};
+#endif
+
+} /* namespace package_manager */
+
+namespace std {
+template <>
+struct is_error_code_enum<package_manager::error> : true_type {
+};
+} /* namespace std */
+
+/**
+ * @}
+ */
+
+#endif /* __TIZEN_APPFW_PACKAGE_MANAGER_HPP */
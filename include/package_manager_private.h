@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __TIZEN_APPFW_PACKAGE_MANAGER_PRIVATE_H
+#define __TIZEN_APPFW_PACKAGE_MANAGER_PRIVATE_H
+
+#include <glib.h>
+#include <package-manager.h>
+#include <package_manager.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shared between the sources of the library, not exported from it */
+#pragma GCC visibility push(hidden)
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "TIZEN_N_PACKAGE_MANAGER"
+
+typedef struct _transaction_member {
+	package_manager_transaction_h transaction;
+	int req_id;
+	char *target;
+	char *package;
+	package_manager_event_type_e event_type;
+	package_manager_event_state_e event_state;
+	int progress;
+	package_manager_error_e error;
+	struct _transaction_member *next;
+} transaction_member;
+
+typedef struct _package_manager_timer package_manager_timer;
+
+typedef void (*package_manager_timer_cb) (package_manager_timer *timer,
+					  void *data);
+
+struct _package_manager_timer {
+	struct _package_manager_timer *next;
+	struct _package_manager_timer **pprev;	/* NULL unless pending */
+	unsigned long long expires;
+	package_manager_timer_cb callback;
+	void *data;
+};
+
+typedef struct _plan_node plan_node;
+
+typedef struct _event_info {
+	int req_id;
+	char *pkg_name;
+	package_manager_event_type_e event_type;
+	package_manager_event_state_e event_state;
+	package_manager_error_e error;	/* reported by the error event */
+	transaction_member *member;
+	package_manager_future_h future;
+	plan_node *node;
+	int timeout;
+	package_manager_timer timer;
+	char *staged;		/* staged copy of the package file */
+	struct _event_info *next;
+} event_info;
+
+/* Outcome of a deferred installation, info is NULL when it failed */
+typedef void (*request_submitted_cb) (void *owner, int ret, int id,
+				      event_info *info);
+
+typedef struct package_manager_storage_s package_manager_storage_s;
+typedef struct package_manager_dispatcher_s package_manager_dispatcher_s;
+typedef struct package_manager_staging_s package_manager_staging_s;
+
+struct package_manager_s {
+	int handle_id;
+	client_type ctype;
+	pkgmgr_client *pc;
+	pkgmgr_mode mode;
+	event_info *head;
+	package_manager_event_cb event_cb;
+	void *user_data;
+	bool listening;
+	package_manager_storage_s *storage;
+	package_manager_dispatcher_s *dispatcher;
+	package_manager_event_bus_e bus_mode;
+	bool attached;
+};
+
+struct package_manager_request_s {
+	int handle_id;
+	client_type ctype;
+	pkgmgr_client *pc;
+	const char *pkg_type;
+	const char *pkg_path;
+	const char *pkg_name;
+	pkgmgr_mode mode;
+	event_info *head;
+	package_manager_request_event_cb event_cb;
+	void *user_data;
+	int timeout;
+	package_manager_staging_s *staging;
+	GSList *transactions;
+	GSList *plans;
+	GHashTable *expired;	/* timed out id -> expired_request */
+	GSList *deferred;	/* installations waiting for their copy */
+	int dispatching;	/* event handlers running for the request */
+	bool destroyed;		/* destroyed from one of them */
+};
+
+int package_manager_error(package_manager_error_e error,
+			  const char *function, const char *description);
+
+int package_manager_client_valiate_handle(package_manager_request_h request);
+int package_manager_valiate_handle(package_manager_h manager);
+int __package_manager_listen(package_manager_h manager);
+void __package_manager_fallback(package_manager_h manager);
+void __manager_deliver(package_manager_h manager, const char *pkg_type,
+		       const char *pkg_name,
+		       package_manager_event_type_e event_type,
+		       package_manager_event_state_e event_state,
+		       int progress, package_manager_error_e error, bool end);
+int __main_invoke(int (*func) (void *data), void *data);
+void __main_invoke_wakeup(void);
+int __request_submit(package_manager_request_h request,
+		     package_manager_event_type_e event_type,
+		     const char *target, int *id, event_info **info);
+void __request_detach_members(package_manager_request_h request,
+			      package_manager_transaction_h transaction);
+void __request_detach_plan(package_manager_request_h request,
+			   package_manager_plan_h plan);
+void __request_staged(void *data);
+int __request_submit_staged(package_manager_request_h request,
+			    const char *target, int *id, event_info **info,
+			    request_submitted_cb submitted, void *owner);
+void __request_cancel_submit(package_manager_request_h request, void *owner);
+
+/* package_manager_storage.c */
+void __storage_destroy(package_manager_storage_s *storage);
+void __storage_handle_event(package_manager_storage_s *storage,
+			    const char *pkg_name,
+			    package_manager_event_type_e event_type);
+
+/* package_manager_transaction.c */
+void __transaction_detach(package_manager_transaction_h transaction);
+void __transaction_member_event(transaction_member *member,
+				const char *pkg_name,
+				package_manager_event_state_e event_state,
+				int progress, package_manager_error_e error);
+
+/* package_manager_plan.c */
+package_manager_plan_h __plan_node_owner(plan_node *node);
+void __plan_detach(package_manager_plan_h plan);
+void __plan_resume(package_manager_plan_h plan);
+void __plan_node_event(plan_node *node,
+		       package_manager_event_state_e event_state,
+		       package_manager_error_e error);
+
+/* package_manager_journal.c */
+void __journal_record(const char *pkg_type, const char *pkg_name,
+		      package_manager_event_type_e event_type,
+		      package_manager_event_state_e event_state,
+		      package_manager_error_e error);
+
+/* package_manager_future.c */
+void __future_complete(package_manager_future_h future,
+		       package_manager_event_state_e event_state,
+		       package_manager_error_e error);
+
+/* package_manager_timer.c */
+void __timer_start(package_manager_timer *timer, int timeout,
+		   package_manager_timer_cb callback, void *data);
+void __timer_stop(package_manager_timer *timer);
+
+/* package_manager_bus.c */
+int __bus_attach(package_manager_h manager);
+void __bus_detach(package_manager_h manager);
+void __bus_start_publishing(package_manager_h manager);
+void __bus_stop_publishing(package_manager_h manager);
+void __bus_publish(package_manager_h manager, const char *pkg_type,
+		   const char *pkg_name,
+		   package_manager_event_type_e event_type,
+		   package_manager_event_state_e event_state, int progress,
+		   package_manager_error_e error, bool end);
+
+/* package_manager_archive.c */
+const char *__archive_detect_type(const char *path);
+
+/* package_manager_staging.c */
+void __staging_destroy(package_manager_staging_s *staging);
+int __staging_queue(package_manager_staging_s *staging, const char *path);
+bool __staging_ready(package_manager_staging_s *staging, const char *path);
+void __staging_prepare(package_manager_staging_s *staging, const char *path);
+void __staging_discard(package_manager_staging_s *staging, const char *path);
+int __staging_take(package_manager_staging_s *staging, const char *path,
+		   char **staged);
+void __staging_release(char *staged);
+
+/* package_manager_dispatcher.c */
+bool __dispatcher_is_current(package_manager_dispatcher_s *dispatcher);
+bool __dispatcher_current_stopping(void);
+void __dispatcher_destroy(package_manager_dispatcher_s *dispatcher);
+void __dispatcher_post(package_manager_dispatcher_s *dispatcher,
+		       package_manager_event_cb callback, void *user_data,
+		       const char *pkg_type, const char *pkg_name,
+		       package_manager_event_type_e event_type,
+		       package_manager_event_state_e event_state,
+		       int progress, package_manager_error_e error);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TIZEN_APPFW_PACKAGE_MANAGER_PRIVATE_H */
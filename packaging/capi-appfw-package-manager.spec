@@ -12,6 +12,8 @@ BuildRequires:  pkgconfig(pkgmgr)
 BuildRequires:  pkgconfig(ail)
 BuildRequires:  pkgconfig(pkgmgr)
 BuildRequires:  pkgconfig(capi-base-common)
+BuildRequires:  pkgconfig(zlib)
+BuildRequires:  pkgconfig(libxml-2.0)
 Requires(post): /sbin/ldconfig
 Requires(postun): /sbin/ldconfig
 
@@ -53,6 +55,7 @@ rm -rf %{buildroot}
 
 %files devel
 %{_includedir}/appfw/package_manager.h
+%{_includedir}/appfw/package_manager.hpp
 %{_libdir}/libcapi-appfw-package-manager.so
 %{_libdir}/pkgconfig/*.pc
 
@@ -14,48 +14,25 @@
  * limitations under the License.
  */
 
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#include <pthread.h>
+#include <glib.h>
 #include <dlog.h>
 
-#include <package-manager.h>
-#include <package_manager.h>
+#include <package_manager_private.h>
 
-#ifdef LOG_TAG
-#undef LOG_TAG
-#endif
+static void __free_event_info(event_info ** head);
+static void __request_free(package_manager_request_h request);
+static void __request_drop_deferred(package_manager_request_h request);
 
-#define LOG_TAG "TIZEN_N_PACKAGE_MANAGER"
-
-typedef struct _event_info {
-	int req_id;
-	package_manager_event_type_e event_type;
-	package_manager_event_state_e event_state;
-	struct _event_info *next;
-} event_info;
-
-struct package_manager_s {
-	int handle_id;
-	client_type ctype;
-	pkgmgr_client *pc;
-	pkgmgr_mode mode;
-	event_info *head;
-	package_manager_event_cb event_cb;
-	void *user_data;
-};
-
-struct package_manager_request_s {
-	int handle_id;
-	client_type ctype;
-	pkgmgr_client *pc;
-	const char *pkg_type;
-	const char *pkg_path;
-	const char *pkg_name;
-	pkgmgr_mode mode;
-	event_info *head;
-	package_manager_request_event_cb event_cb;
-	void *user_data;
-};
+/*
+ * Handles receiving package events in this process, directly or from the
+ * event bus. The first one feeds the journal.
+ */
+static GSList *listeners;
 
 static int package_manager_request_new_id()
 {
@@ -84,13 +61,20 @@ static const char *package_manager_error_to_string(package_manager_error_e
 
 	case PACKAGE_MANAGER_ERROR_IO_ERROR:
 		return "IO_ERROR";
+
+	case PACKAGE_MANAGER_ERROR_TIMED_OUT:
+		return "TIMED_OUT";
+
+	case PACKAGE_MANAGER_ERROR_CANCELED:
+		return "CANCELED";
+
 	default:
 		return "UNKNOWN";
 	}
 }
 
-static int package_manager_error(package_manager_error_e error,
-				 const char *function, const char *description)
+int package_manager_error(package_manager_error_e error,
+			  const char *function, const char *description)
 {
 	if (description) {
 		LOGE("[%s] %s(0x%08x) : %s", function,
@@ -141,18 +125,19 @@ int package_manager_request_create(package_manager_request_h * request)
 	return PACKAGE_MANAGER_ERROR_NONE;
 }
 
-static int package_manager_client_valiate_handle(package_manager_request_h
-						 request)
+int package_manager_client_valiate_handle(package_manager_request_h request)
 {
-	if (request == NULL || request->pc == NULL) {
+	if (request == NULL || request->pc == NULL || request->destroyed) {
 		return PACKAGE_MANAGER_ERROR_INVALID_PARAMETER;
 	}
 
 	return PACKAGE_MANAGER_ERROR_NONE;
 }
 
-int package_manager_client_destroy(package_manager_request_h request)
+int package_manager_reqeust_destroy(package_manager_request_h request)
 {
+	event_info *info;
+
 	if (package_manager_client_valiate_handle(request)) {
 		return
 		    package_manager_error
@@ -160,11 +145,78 @@ int package_manager_client_destroy(package_manager_request_h request)
 		     NULL);
 	}
 
+	/* Transactions and plans outliving the request are no longer reported */
+	g_slist_free_full(request->transactions,
+			  (GDestroyNotify) __transaction_detach);
+	request->transactions = NULL;
+	g_slist_free_full(request->plans, (GDestroyNotify) __plan_detach);
+	request->plans = NULL;
+	for (info = request->head; info; info = info->next) {
+		info->member = NULL;
+		info->node = NULL;
+	}
+	__request_drop_deferred(request);
+
+	/* Freed once the event handler calling back the user returns */
+	if (request->dispatching > 0) {
+		request->event_cb = NULL;
+		request->destroyed = true;
+		return PACKAGE_MANAGER_ERROR_NONE;
+	}
+
+	__request_free(request);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+/*
+ * An installation waiting for its staged copy, submitted from the main
+ * loop by __request_staged() once the copy is done
+ */
+typedef struct _deferred_submit {
+	char *target;
+	request_submitted_cb submitted;
+	void *owner;
+} deferred_submit;
+
+static void __deferred_free(deferred_submit *deferred)
+{
+	free(deferred->target);
+	free(deferred);
+}
+
+/* Their owners are told that they could not be submitted */
+static void __request_drop_deferred(package_manager_request_h request)
+{
+	deferred_submit *deferred;
+
+	while (request->deferred) {
+		deferred = request->deferred->data;
+		request->deferred = g_slist_remove(request->deferred,
+						   deferred);
+		deferred->submitted(deferred->owner,
+				    PACKAGE_MANAGER_ERROR_IO_ERROR, -1, NULL);
+		__deferred_free(deferred);
+	}
+}
+
+static void __request_free(package_manager_request_h request)
+{
+	__free_event_info(&(request->head));
+	if (request->expired)
+		g_hash_table_destroy(request->expired);
+
+	if (request->staging)
+		__staging_destroy(request->staging);
+
 	pkgmgr_client_free(request->pc);
 	request->pc = NULL;
 	free(request);
+}
 
-	return PACKAGE_MANAGER_ERROR_NONE;
+int package_manager_client_destroy(package_manager_request_h request)
+{
+	return package_manager_reqeust_destroy(request);
 }
 
 int package_manager_request_set_event_cb(package_manager_request_h request,
@@ -224,6 +276,21 @@ int package_manager_request_set_mode(package_manager_request_h request,
 	return PACKAGE_MANAGER_ERROR_NONE;
 }
 
+int package_manager_request_set_timeout(package_manager_request_h request,
+					int timeout)
+{
+	if (package_manager_client_valiate_handle(request) || timeout < 0) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	request->timeout = timeout;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
 static int package_manager_get_event_type(const char *key,
 					  package_manager_event_type_e *
 					  event_type)
@@ -235,7 +302,7 @@ static int package_manager_get_event_type(const char *key,
 		*event_type = PACAKGE_MANAGER_EVENT_TYPE_INSTALL;
 	else if (strcasecmp(key, "uninstall") == 0)
 		*event_type = PACAKGE_MANAGER_EVENT_TYPE_UNINSTALL;
-	else if (strcasecmp(key, "undate") == 0)
+	else if (strcasecmp(key, "update") == 0)
 		*event_type = PACAKGE_MANAGER_EVENT_TYPE_UPDATE;
 	else
 		return PACKAGE_MANAGER_ERROR_INVALID_PARAMETER;
@@ -258,6 +325,7 @@ static int __add_event_info(event_info ** head, int req_id,
 	}
 	evt_info->req_id = req_id;
 	evt_info->event_type = event_type;
+	evt_info->event_state = event_state;
 	evt_info->next = NULL;
 
 	if (*head == NULL)
@@ -288,11 +356,12 @@ static int __find_event_info(event_info ** head, int req_id,
 		return -1;
 	}
 
-	LOGD("tmp->req_id %d, event_type %d", tmp->req_id, event_type);
+	LOGD("tmp->req_id %d", tmp->req_id);
 
 	while (tmp) {
 		if (tmp->req_id == req_id) {
 			*event_type = tmp->event_type;
+			*event_state = tmp->event_state;
 			return 0;
 		}
 		tmp = tmp->next;
@@ -321,6 +390,7 @@ static int __update_event_info(event_info ** head, int req_id,
 		while (tmp) {
 			if (tmp->req_id == req_id) {
 				tmp->event_type = event_type;
+				tmp->event_state = event_state;
 				return 0;
 			}
 			tmp = tmp->next;
@@ -330,41 +400,350 @@ static int __update_event_info(event_info ** head, int req_id,
 	return -1;
 }
 
-/*
-static int __remove_event_info(event_info **head request, int req_id)
+static event_info *__get_event_info(event_info *head, int req_id)
+{
+	while (head) {
+		if (head->req_id == req_id)
+			return head;
+		head = head->next;
+	}
+
+	return NULL;
+}
+
+static int __remove_event_info(event_info ** head, int req_id)
 {
 	event_info *current;
 	event_info *tmp;
 
-	if (* == NULL)
+	if (*head == NULL)
 		return -1;
 
+	if ((*head)->req_id == req_id) {
+		tmp = *head;
+		*head = tmp->next;
+		__timer_stop(&tmp->timer);
+		__staging_release(tmp->staged);
+		free(tmp->pkg_name);
+		free(tmp);
+		return 0;
+	}
+
 	current = *head;
-	while (current) {
-		if (current->next) {
-			if (current->next->req_id == req_id) {
-				tmp = current->next;
-				current->next = current->next->next;
-				free(tmp);
-				return 0;
-			}
+	while (current->next) {
+		if (current->next->req_id == req_id) {
+			tmp = current->next;
+			current->next = tmp->next;
+			__timer_stop(&tmp->timer);
+			__staging_release(tmp->staged);
+			free(tmp->pkg_name);
+			free(tmp);
+			return 0;
 		}
-		tmp = tmp->next;
+		current = current->next;
 	}
 
 	return -1;
 }
-*/
 
-static int request_event_handler(int req_id, const char *pkg_type,
-				 const char *pkg_name, const char *key,
-				 const char *val, const void *pmsg, void *data)
+static void __free_event_info(event_info ** head)
+{
+	event_info *tmp;
+
+	while (*head) {
+		tmp = *head;
+		*head = tmp->next;
+		__timer_stop(&tmp->timer);
+		if (tmp->future)
+			__future_complete(tmp->future,
+					  PACAKGE_MANAGER_EVENT_STATE_FAILED,
+					  PACKAGE_MANAGER_ERROR_IO_ERROR);
+		__staging_release(tmp->staged);
+		free(tmp->pkg_name);
+		free(tmp);
+	}
+}
+
+/*
+ * Reports the end of a request to what waits for it, then forgets it.
+ * The callbacks may destroy the transaction, the plan or the request
+ * handle itself, which is then only freed once the handler returns, so
+ * the entry is looked up again after each of them.
+ */
+static void __request_finish(package_manager_request_h request, int req_id,
+			     const char *pkg_name,
+			     package_manager_event_state_e event_state,
+			     package_manager_error_e error)
+{
+	event_info *info;
+
+	/* The completion callback runs later, from the main loop */
+	info = __get_event_info(request->head, req_id);
+	if (info && info->future) {
+		__future_complete(info->future, event_state, error);
+		info->future = NULL;
+	}
+
+	if (info && info->member)
+		__transaction_member_event(info->member, pkg_name,
+					   event_state, 100, error);
+
+	info = __get_event_info(request->head, req_id);
+	if (info && info->node)
+		__plan_node_event(info->node, event_state, error);
+
+	__remove_event_info(&(request->head), req_id);
+}
+
+static void __request_leave(package_manager_request_h request)
+{
+	if (--request->dispatching == 0 && request->destroyed)
+		__request_free(request);
+}
+
+/*
+ * The late events of a request which timed out are dropped until its end,
+ * or until it has been silent for another timeout if its end never comes.
+ */
+typedef struct _expired_request {
+	package_manager_timer timer;
+	package_manager_request_h request;
+	int req_id;
+	int timeout;
+} expired_request;
+
+static void __expired_free(gpointer data)
+{
+	expired_request *expired = data;
+
+	__timer_stop(&expired->timer);
+	free(expired);
+}
+
+static void __expired_timeout(package_manager_timer *timer, void *data)
+{
+	expired_request *expired = data;
+
+	g_hash_table_remove(expired->request->expired,
+			    GINT_TO_POINTER(expired->req_id));
+}
+
+static void __request_expire(package_manager_request_h request, int req_id,
+			     int timeout)
+{
+	expired_request *expired;
+
+	if (request->expired == NULL)
+		request->expired = g_hash_table_new_full(g_direct_hash,
+							 g_direct_equal, NULL,
+							 __expired_free);
+	if (request->expired == NULL)
+		return;
+
+	expired = calloc(1, sizeof(expired_request));
+	if (expired == NULL)
+		return;
+
+	expired->request = request;
+	expired->req_id = req_id;
+	expired->timeout = timeout;
+	g_hash_table_replace(request->expired, GINT_TO_POINTER(req_id),
+			     expired);
+	__timer_start(&expired->timer, timeout, __expired_timeout, expired);
+}
+
+/* Whether the event belongs to a request which timed out, and drops it */
+static bool __request_expired(package_manager_request_h request, int req_id,
+			      const char *key)
+{
+	expired_request *expired;
+
+	if (request->expired == NULL)
+		return false;
+
+	expired = g_hash_table_lookup(request->expired,
+				      GINT_TO_POINTER(req_id));
+	if (expired == NULL)
+		return false;
+
+	LOGD("dropping %s event of expired request %d", key, req_id);
+
+	if (strcasecmp(key, "end") == 0)
+		g_hash_table_remove(request->expired, GINT_TO_POINTER(req_id));
+	else
+		__timer_start(&expired->timer, expired->timeout,
+			      __expired_timeout, expired);
+
+	return true;
+}
+
+static void __request_timeout(package_manager_timer *timer, void *data)
+{
+	package_manager_request_h request = data;
+	event_info *info;
+	int req_id;
+
+	info = (event_info *) ((char *)timer - offsetof(event_info, timer));
+	req_id = info->req_id;
+
+	LOGE("request %d got no event for %d ms, giving up", req_id,
+	     info->timeout);
+
+	request->dispatching++;
+
+	/* Events the installer still sends for it are dropped */
+	__request_expire(request, req_id, info->timeout);
+
+	if (request->event_cb)
+		request->event_cb(req_id, request->pkg_type, info->pkg_name,
+				  info->event_type,
+				  PACAKGE_MANAGER_EVENT_STATE_FAILED, 0,
+				  PACKAGE_MANAGER_ERROR_TIMED_OUT,
+				  request->user_data);
+
+	__request_finish(request, req_id, NULL,
+			 PACAKGE_MANAGER_EVENT_STATE_FAILED,
+			 PACKAGE_MANAGER_ERROR_TIMED_OUT);
+
+	__request_leave(request);
+}
+
+/*
+ * Submits an installation right away if its file is staged, otherwise
+ * once it is: *info is then NULL and the outcome goes to submitted.
+ */
+int __request_submit_staged(package_manager_request_h request,
+			    const char *target, int *id, event_info **info,
+			    request_submitted_cb submitted, void *owner)
+{
+	deferred_submit *deferred;
+
+	if (request->staging == NULL
+	    || __staging_ready(request->staging, target))
+		return __request_submit(request,
+					PACAKGE_MANAGER_EVENT_TYPE_INSTALL,
+					target, id, info);
+
+	deferred = calloc(1, sizeof(deferred_submit));
+	if (deferred)
+		deferred->target = strdup(target);
+	if (deferred == NULL || deferred->target == NULL) {
+		free(deferred);
+		return PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY;
+	}
+
+	deferred->submitted = submitted;
+	deferred->owner = owner;
+	request->deferred = g_slist_append(request->deferred, deferred);
+
+	*id = -1;
+	*info = NULL;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+/* Drops the installations of an owner going away, they are not submitted */
+void __request_cancel_submit(package_manager_request_h request, void *owner)
+{
+	deferred_submit *deferred;
+	GSList *l = request->deferred;
+
+	while (l) {
+		deferred = l->data;
+		l = l->next;
+		if (deferred->owner != owner)
+			continue;
+
+		request->deferred = g_slist_remove(request->deferred,
+						   deferred);
+		if (request->staging)
+			__staging_discard(request->staging, deferred->target);
+		__deferred_free(deferred);
+	}
+}
+
+/* Submits the deferred installations whose copy is done, in order */
+static void __request_submit_deferred(package_manager_request_h request)
+{
+	deferred_submit *deferred;
+	event_info *info;
+	GSList *l = request->deferred;
+	int id;
+	int ret;
+
+	while (l && !request->destroyed) {
+		deferred = l->data;
+		if (request->staging
+		    && !__staging_ready(request->staging, deferred->target)) {
+			l = l->next;
+			continue;
+		}
+
+		request->deferred = g_slist_remove(request->deferred,
+						   deferred);
+
+		ret = __request_submit(request,
+				       PACAKGE_MANAGER_EVENT_TYPE_INSTALL,
+				       deferred->target, &id, &info);
+		if (ret != PACKAGE_MANAGER_ERROR_NONE) {
+			LOGE("failed to submit %s (%d)", deferred->target,
+			     ret);
+			info = NULL;
+		}
+
+		/* May cancel or defer other installations */
+		deferred->submitted(deferred->owner, ret, id, info);
+		__deferred_free(deferred);
+
+		l = request->deferred;
+	}
+}
+
+/* Resumes what waits for a staged file, once one is done */
+void __request_staged(void *data)
+{
+	package_manager_request_h request = data;
+	GSList *plans;
+	GSList *l;
+
+	request->dispatching++;
+
+	__request_submit_deferred(request);
+
+	/* Plan callbacks may destroy plans, or the request */
+	plans = g_slist_copy(request->plans);
+	for (l = plans; l; l = l->next) {
+		if (g_slist_find(request->plans, l->data))
+			__plan_resume(l->data);
+	}
+	g_slist_free(plans);
+
+	__request_leave(request);
+}
+
+/* Restarts the timeout of a request, called for each of its events */
+static void __request_touch(package_manager_request_h request,
+			    event_info *info)
+{
+	if (info == NULL)
+		return;
+
+	if (info->timeout > 0)
+		__timer_start(&info->timer, info->timeout, __request_timeout,
+			      request);
+	else
+		__timer_stop(&info->timer);
+}
+
+static int __request_event(int req_id, const char *pkg_type,
+			   const char *pkg_name, const char *key,
+			   const char *val, void *data)
 {
 	int ret = -1;
 	package_manager_event_type_e event_type = -1;
 	package_manager_event_state_e event_state = -1;
-
-	LOGD("request_event_handler is called");
+	package_manager_error_e error = PACKAGE_MANAGER_ERROR_NONE;
+	event_info *info;
 
 	package_manager_request_h request = data;
 
@@ -373,8 +752,8 @@ static int request_event_handler(int req_id, const char *pkg_type,
 		if (ret != PACKAGE_MANAGER_ERROR_NONE)
 			return PACKAGE_MANAGER_ERROR_INVALID_PARAMETER;
 
-		__add_event_info(&(request->head), req_id, event_type,
-				 PACAKGE_MANAGER_EVENT_STATE_STARTED);
+		__update_event_info(&(request->head), req_id, event_type,
+				    PACAKGE_MANAGER_EVENT_STATE_STARTED);
 
 		if (request->event_cb)
 			request->event_cb(req_id, pkg_type, pkg_name,
@@ -382,6 +761,17 @@ static int request_event_handler(int req_id, const char *pkg_type,
 					  PACAKGE_MANAGER_EVENT_STATE_STARTED,
 					  0, PACKAGE_MANAGER_ERROR_NONE, request->user_data);
 
+		info = __get_event_info(request->head, req_id);
+		if (info && pkg_name) {
+			free(info->pkg_name);
+			info->pkg_name = strdup(pkg_name);
+		}
+		if (info && info->member)
+			__transaction_member_event(info->member, pkg_name,
+						   PACAKGE_MANAGER_EVENT_STATE_STARTED,
+						   0, PACKAGE_MANAGER_ERROR_NONE);
+		__request_touch(request, info);
+
 	} else if (strcasecmp(key, "install_percent") == 0
 		   || strcasecmp(key, "progress_percent") == 0) {
 		if (__find_event_info
@@ -397,16 +787,33 @@ static int request_event_handler(int req_id, const char *pkg_type,
 						  atoi(val),
 						  PACKAGE_MANAGER_ERROR_NONE,
 						  request->user_data);
+
+			info = __get_event_info(request->head, req_id);
+			if (info && info->member)
+				__transaction_member_event(info->member,
+							   pkg_name,
+							   PACAKGE_MANAGER_EVENT_STATE_PROCESSING,
+							   atoi(val),
+							   PACKAGE_MANAGER_ERROR_NONE);
+			__request_touch(request, info);
 		}
 
 	} else if (strcasecmp(key, "error") == 0) {
-		if (strcasecmp(key, "0") != 0) {
+		if (strcasecmp(val, "0") != 0) {
 			if (__find_event_info
 			    (&(request->head), req_id, &event_type,
 			     &event_state) == 0) {
 				__update_event_info(&(request->head), req_id,
 						    event_type,
 						    PACAKGE_MANAGER_EVENT_STATE_FAILED);
+				info = __get_event_info(request->head, req_id);
+				if (info) {
+					LOGE("request %d failed (%s)", req_id,
+					     val);
+					info->error =
+					    PACKAGE_MANAGER_ERROR_IO_ERROR;
+				}
+				__request_touch(request, info);
 			}
 
 			if (request->event_cb)
@@ -422,7 +829,26 @@ static int request_event_handler(int req_id, const char *pkg_type,
 		if (__find_event_info
 		    (&(request->head), req_id, &event_type,
 		     &event_state) == 0) {
+			info = __get_event_info(request->head, req_id);
+
+			/* An unsuccessful end may come without an error event */
+			if (event_state != PACAKGE_MANAGER_EVENT_STATE_FAILED
+			    && strcasecmp(val, "ok") != 0) {
+				event_state = PACAKGE_MANAGER_EVENT_STATE_FAILED;
+				if (request->event_cb)
+					request->event_cb(req_id, pkg_type,
+							  pkg_name, event_type,
+							  PACAKGE_MANAGER_EVENT_STATE_FAILED,
+							  0,
+							  PACKAGE_MANAGER_ERROR_NONE,
+							  request->user_data);
+			}
+			if (event_state == PACAKGE_MANAGER_EVENT_STATE_FAILED)
+				error = info && info->error ? info->error :
+				    PACKAGE_MANAGER_ERROR_IO_ERROR;
+
 			if (event_state != PACAKGE_MANAGER_EVENT_STATE_FAILED) {
+				event_state = PACAKGE_MANAGER_EVENT_STATE_COMPLETED;
 				if (request->event_cb)
 					request->event_cb(req_id, pkg_type,
 							  pkg_name, event_type,
@@ -431,8 +857,11 @@ static int request_event_handler(int req_id, const char *pkg_type,
 							  PACKAGE_MANAGER_ERROR_NONE,
 							  request->user_data);
 			}
+
+			__request_finish(request, req_id, pkg_name,
+					 event_state, error);
 		} else {
-			if (strcasecmp(key, "ok") != 0)
+			if (strcasecmp(val, "ok") != 0)
 				if (request->event_cb)
 					request->event_cb(req_id, pkg_type,
 							  pkg_name, event_type,
@@ -446,41 +875,309 @@ static int request_event_handler(int req_id, const char *pkg_type,
 	return PACKAGE_MANAGER_ERROR_NONE;
 }
 
-int package_manager_request_install(package_manager_request_h request,
-				    const char *path, int *id)
+static int request_event_handler(int req_id, const char *pkg_type,
+				 const char *pkg_name, const char *key,
+				 const char *val, const void *pmsg, void *data)
+{
+	package_manager_request_h request = data;
+	int ret;
+
+	LOGD("request_event_handler is called");
+
+	/* The request has already failed with a timeout */
+	if (__request_expired(request, req_id, key))
+		return PACKAGE_MANAGER_ERROR_NONE;
+
+	/* The callbacks may destroy the request, keep it until we are done */
+	request->dispatching++;
+	ret = __request_event(req_id, pkg_type, pkg_name, key, val, request);
+	__request_leave(request);
+
+	return ret;
+}
+
+int __request_submit(package_manager_request_h request,
+		     package_manager_event_type_e event_type,
+		     const char *target, int *id, event_info **info)
 {
+	event_info *tracked;
+	const char *pkg_type;
+	char *staged = NULL;
 	int request_id = 0;
-	request->pkg_path = path;
-	request_id = pkgmgr_client_install(request->pc, request->pkg_type, NULL,
-					   request->pkg_path, NULL,
-					   request->mode, request_event_handler,
-					   request);
+	int ret;
+
+	if (event_type == PACAKGE_MANAGER_EVENT_TYPE_UNINSTALL) {
+		request->pkg_name = target;
+		request_id = pkgmgr_client_uninstall(request->pc,
+						     request->pkg_type,
+						     request->pkg_name,
+						     PM_DEFAULT,
+						     request_event_handler,
+						     request);
+	} else {
+		if (request->staging) {
+			ret = __staging_take(request->staging, target, &staged);
+			if (ret != PACKAGE_MANAGER_ERROR_NONE)
+				return ret;
+		}
 
-	if (request_id < 0)
+		request->pkg_path = staged ? staged : target;
+		pkg_type = request->pkg_type;
+		if (pkg_type == NULL)
+			pkg_type = __archive_detect_type(request->pkg_path);
+		request_id = pkgmgr_client_install(request->pc,
+						   pkg_type, NULL,
+						   request->pkg_path, NULL,
+						   request->mode,
+						   request_event_handler,
+						   request);
+	}
+
+	if (request_id < 0) {
+		__staging_release(staged);
 		return PACKAGE_MANAGER_ERROR_INVALID_PARAMETER;
+	}
 
 	*id = request_id;
 
+	/*
+	 * Track the request right away so that it can be routed to its owner
+	 * and given up if the package manager never answers
+	 */
+	__update_event_info(&(request->head), request_id, event_type,
+			    PACAKGE_MANAGER_EVENT_STATE_STARTED);
+	tracked = __get_event_info(request->head, request_id);
+	if (tracked) {
+		tracked->pkg_name = strdup(target);
+		tracked->timeout = request->timeout;
+		tracked->staged = staged;
+		__request_touch(request, tracked);
+	} else if (staged) {
+		/* Nobody would see the end of the installation */
+		LOGW("leaving staged file %s behind", staged);
+		free(staged);
+	}
+
+	if (info) {
+		*info = tracked;
+		if (tracked == NULL)
+			return PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY;
+	}
+
 	return PACKAGE_MANAGER_ERROR_NONE;
 }
 
-int package_manager_request_uninstall(package_manager_request_h request,
-				      const char *name, int *id)
+void __request_detach_members(package_manager_request_h request,
+			      package_manager_transaction_h transaction)
 {
-	int request_id = 0;
-	request->pkg_name = name;
-	request_id = pkgmgr_client_uninstall(request->pc, request->pkg_type,
-					     request->pkg_name, PM_DEFAULT,
-					     request_event_handler, request);
+	event_info *info;
+
+	for (info = request->head; info; info = info->next) {
+		if (info->member && info->member->transaction == transaction)
+			info->member = NULL;
+	}
+}
+
+void __request_detach_plan(package_manager_request_h request,
+			   package_manager_plan_h plan)
+{
+	event_info *info;
+
+	for (info = request->head; info; info = info->next) {
+		if (info->node && __plan_node_owner(info->node) == plan)
+			info->node = NULL;
+	}
+}
+
+typedef struct _main_call {
+	int (*func) (void *data);
+	void *data;
+	int ret;
+	bool running;
+	bool done;
+	bool abandoned;		/* by a dispatch worker being stopped */
+} main_call;
+
+/* Shared by all the calls, the workers of a stopping dispatcher wake up */
+static pthread_mutex_t main_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t main_cond = PTHREAD_COND_INITIALIZER;
+
+static gboolean __main_call_run(gpointer data)
+{
+	main_call *call = data;
+	int ret;
+
+	pthread_mutex_lock(&main_lock);
+	if (call->abandoned) {
+		pthread_mutex_unlock(&main_lock);
+		free(call);
+		return FALSE;
+	}
+	call->running = true;
+	pthread_mutex_unlock(&main_lock);
+
+	ret = call->func(call->data);
+
+	pthread_mutex_lock(&main_lock);
+	call->ret = ret;
+	call->done = true;
+	pthread_cond_broadcast(&main_cond);
+	pthread_mutex_unlock(&main_lock);
+
+	return FALSE;
+}
+
+/* Called once a dispatcher is stopping, see __main_invoke() */
+void __main_invoke_wakeup(void)
+{
+	pthread_mutex_lock(&main_lock);
+	pthread_cond_broadcast(&main_cond);
+	pthread_mutex_unlock(&main_lock);
+}
+
+/*
+ * Runs func on the thread dispatching the package manager events, which
+ * owns the tracked requests and the timers, and waits for its result.
+ * It runs right away when called from that thread, or when no thread is
+ * running the main loop.
+ *
+ * A parallel event callback gives up when its dispatcher is being
+ * stopped: the main thread would be joining it rather than running the
+ * main loop.
+ */
+int __main_invoke(int (*func) (void *data), void *data)
+{
+	main_call *call;
+	int ret;
 
-	if (request_id < 0)
+	call = calloc(1, sizeof(main_call));
+	if (call == NULL)
+		return PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY;
+
+	call->func = func;
+	call->data = data;
+
+	g_main_context_invoke(NULL, __main_call_run, call);
+
+	pthread_mutex_lock(&main_lock);
+	while (!call->done
+	       && (call->running || !__dispatcher_current_stopping()))
+		pthread_cond_wait(&main_cond, &main_lock);
+
+	if (!call->done) {
+		/* Freed by __main_call_run(), which no longer runs func */
+		call->abandoned = true;
+		pthread_mutex_unlock(&main_lock);
+		LOGE("the event dispatcher is stopping, giving up");
+		return PACKAGE_MANAGER_ERROR_IO_ERROR;
+	}
+
+	ret = call->ret;
+	pthread_mutex_unlock(&main_lock);
+
+	free(call);
+
+	return ret;
+}
+
+typedef struct _submit_call {
+	package_manager_request_h request;
+	package_manager_event_type_e event_type;
+	const char *target;
+	int *id;
+	int timeout;
+} submit_call;
+
+static int __set_request_timeout(void *data)
+{
+	submit_call *call = data;
+	event_info *info;
+
+	info = __get_event_info(call->request->head, *call->id);
+	if (info == NULL)
 		return PACKAGE_MANAGER_ERROR_INVALID_PARAMETER;
 
-	*id = request_id;
+	info->timeout = call->timeout;
+	__request_touch(call->request, info);
 
 	return PACKAGE_MANAGER_ERROR_NONE;
 }
 
+int package_manager_request_set_request_timeout(package_manager_request_h request,
+						int id, int timeout)
+{
+	submit_call call = {
+		.request = request,
+		.id = &id,
+		.timeout = timeout,
+	};
+
+	if (package_manager_client_valiate_handle(request) || timeout < 0) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	if (__main_invoke(__set_request_timeout, &call)) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     "no such request in progress");
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+static int __submit(void *data)
+{
+	submit_call *call = data;
+
+	return __request_submit(call->request, call->event_type, call->target,
+				call->id, NULL);
+}
+
+int package_manager_request_install(package_manager_request_h request,
+				    const char *path, int *id)
+{
+	submit_call call = {
+		.request = request,
+		.event_type = PACAKGE_MANAGER_EVENT_TYPE_INSTALL,
+		.target = path,
+		.id = id,
+	};
+
+	bool staging;
+	int ret;
+
+	/* Copied here rather than on the main loop */
+	staging = package_manager_client_valiate_handle(request) == 0
+	    && request->staging && path;
+	if (staging)
+		__staging_prepare(request->staging, path);
+
+	ret = __main_invoke(__submit, &call);
+
+	/* The copy would stay around until the staging is dropped */
+	if (ret != PACKAGE_MANAGER_ERROR_NONE && staging && request->staging)
+		__staging_discard(request->staging, path);
+
+	return ret;
+}
+
+int package_manager_request_uninstall(package_manager_request_h request,
+				      const char *name, int *id)
+{
+	submit_call call = {
+		.request = request,
+		.event_type = PACAKGE_MANAGER_EVENT_TYPE_UNINSTALL,
+		.target = name,
+		.id = id,
+	};
+
+	return __main_invoke(__submit, &call);
+}
+
 int package_manager_create(package_manager_h * manager)
 {
 	struct package_manager_s *package_manager = NULL;
@@ -517,7 +1214,7 @@ int package_manager_create(package_manager_h * manager)
 	return PACKAGE_MANAGER_ERROR_NONE;
 }
 
-static int package_manager_valiate_handle(package_manager_h manager)
+int package_manager_valiate_handle(package_manager_h manager)
 {
 	if (manager == NULL || manager->pc == NULL) {
 		return PACKAGE_MANAGER_ERROR_INVALID_PARAMETER;
@@ -535,6 +1232,28 @@ int package_manager_destroy(package_manager_h manager)
 		     NULL);
 	}
 
+	/* A worker cannot wait for itself to stop */
+	if (__dispatcher_is_current(manager->dispatcher)) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     "called from a parallel event callback");
+	}
+
+	if (manager->attached)
+		__bus_detach(manager);
+	__bus_stop_publishing(manager);
+
+	if (manager->dispatcher)
+		__dispatcher_destroy(manager->dispatcher);
+
+	if (manager->storage)
+		__storage_destroy(manager->storage);
+
+	__free_event_info(&(manager->head));
+
+	listeners = g_slist_remove(listeners, manager);
+
 	pkgmgr_client_free(manager->pc);
 	manager->pc = NULL;
 	free(manager);
@@ -542,6 +1261,56 @@ int package_manager_destroy(package_manager_h manager)
 	return PACKAGE_MANAGER_ERROR_NONE;
 }
 
+static void __manager_event(package_manager_h manager, const char *pkg_type,
+			    const char *pkg_name,
+			    package_manager_event_type_e event_type,
+			    package_manager_event_state_e event_state,
+			    int progress, package_manager_error_e error)
+{
+	if (manager->event_cb == NULL)
+		return;
+
+	if (manager->dispatcher) {
+		__dispatcher_post(manager->dispatcher, manager->event_cb,
+				  manager->user_data, pkg_type, pkg_name,
+				  event_type, event_state, progress, error);
+		return;
+	}
+
+	manager->event_cb(pkg_type, pkg_name, event_type, event_state,
+			  progress, error, manager->user_data);
+}
+
+/*
+ * Delivers a decoded package event to a listening handle. Terminal events
+ * (end) only reach the callback when they complete, as failures have
+ * already been reported by the error event.
+ */
+void __manager_deliver(package_manager_h manager, const char *pkg_type,
+		       const char *pkg_name,
+		       package_manager_event_type_e event_type,
+		       package_manager_event_state_e event_state,
+		       int progress, package_manager_error_e error, bool end)
+{
+	__bus_publish(manager, pkg_type, pkg_name, event_type, event_state,
+		      progress, error, end);
+
+	if (!end || event_state == PACAKGE_MANAGER_EVENT_STATE_COMPLETED)
+		__manager_event(manager, pkg_type, pkg_name, event_type,
+				event_state, progress, error);
+
+	if (!end)
+		return;
+
+	if (event_state == PACAKGE_MANAGER_EVENT_STATE_COMPLETED
+	    && manager->storage)
+		__storage_handle_event(manager->storage, pkg_name, event_type);
+
+	if (listeners && listeners->data == manager)
+		__journal_record(pkg_type, pkg_name, event_type, event_state,
+				 error);
+}
+
 static int global_event_handler(int req_id, const char *pkg_type,
 				const char *pkg_name, const char *key,
 				const char *val, const void *pmsg, void *data)
@@ -549,6 +1318,8 @@ static int global_event_handler(int req_id, const char *pkg_type,
 	int ret = -1;
 	package_manager_event_type_e event_type = -1;
 	package_manager_event_state_e event_state = -1;
+	package_manager_error_e error = PACKAGE_MANAGER_ERROR_NONE;
+	event_info *info;
 
 	LOGD("global_event_handler is called");
 
@@ -562,11 +1333,9 @@ static int global_event_handler(int req_id, const char *pkg_type,
 		__add_event_info(&(manager->head), req_id, event_type,
 				 PACAKGE_MANAGER_EVENT_STATE_STARTED);
 
-		if (manager->event_cb)
-			manager->event_cb(pkg_type, pkg_name,
-					  event_type,
-					  PACAKGE_MANAGER_EVENT_STATE_STARTED,
-					  0, PACKAGE_MANAGER_ERROR_NONE, manager->user_data);
+		__manager_deliver(manager, pkg_type, pkg_name, event_type,
+				  PACAKGE_MANAGER_EVENT_STATE_STARTED, 0,
+				  PACKAGE_MANAGER_ERROR_NONE, false);
 
 	} else if (strcasecmp(key, "install_percent") == 0
 		   || strcasecmp(key, "progress_percent") == 0) {
@@ -576,67 +1345,132 @@ static int global_event_handler(int req_id, const char *pkg_type,
 			__update_event_info(&(manager->head), req_id,
 					    event_type,
 					    PACAKGE_MANAGER_EVENT_STATE_PROCESSING);
-			if (manager->event_cb)
-				manager->event_cb(pkg_type, pkg_name,
-						  event_type,
-						  PACAKGE_MANAGER_EVENT_STATE_PROCESSING,
-						  atoi(val),
-						  PACKAGE_MANAGER_ERROR_NONE,
-						  manager->user_data);
+			__manager_deliver(manager, pkg_type, pkg_name,
+					  event_type,
+					  PACAKGE_MANAGER_EVENT_STATE_PROCESSING,
+					  atoi(val), PACKAGE_MANAGER_ERROR_NONE,
+					  false);
 		}
 
 	} else if (strcasecmp(key, "error") == 0) {
-		if (strcasecmp(key, "0") != 0) {
+		if (strcasecmp(val, "0") != 0) {
+			LOGE("request %d failed (%s)", req_id, val);
 			if (__find_event_info
 			    (&(manager->head), req_id, &event_type,
 			     &event_state) == 0) {
 				__update_event_info(&(manager->head), req_id,
 						    event_type,
 						    PACAKGE_MANAGER_EVENT_STATE_FAILED);
+				info = __get_event_info(manager->head, req_id);
+				if (info)
+					info->error =
+					    PACKAGE_MANAGER_ERROR_IO_ERROR;
 			}
 
-			if (manager->event_cb)
-				manager->event_cb(pkg_type,
-						  pkg_name, event_type,
-						  PACAKGE_MANAGER_EVENT_STATE_FAILED,
-						  0,
-						  PACKAGE_MANAGER_ERROR_NONE,
-						  manager->user_data);
+			__manager_deliver(manager, pkg_type, pkg_name,
+					  event_type,
+					  PACAKGE_MANAGER_EVENT_STATE_FAILED, 0,
+					  PACKAGE_MANAGER_ERROR_IO_ERROR, false);
 
 		}
 	} else if (strcasecmp(key, "end") == 0) {
 		if (__find_event_info
 		    (&(manager->head), req_id, &event_type,
 		     &event_state) == 0) {
-			if (event_state != PACAKGE_MANAGER_EVENT_STATE_FAILED) {
-				if (manager->event_cb)
-					manager->event_cb(pkg_type,
-							  pkg_name, event_type,
-							  PACAKGE_MANAGER_EVENT_STATE_COMPLETED,
-							  100,
-							  PACKAGE_MANAGER_ERROR_NONE,
-							  manager->user_data);
+			info = __get_event_info(manager->head, req_id);
+
+			/* An unsuccessful end may come without an error event */
+			if (event_state != PACAKGE_MANAGER_EVENT_STATE_FAILED
+			    && strcasecmp(val, "ok") != 0) {
+				event_state = PACAKGE_MANAGER_EVENT_STATE_FAILED;
+				__manager_deliver(manager, pkg_type, pkg_name,
+						  event_type, event_state, 0,
+						  PACKAGE_MANAGER_ERROR_IO_ERROR,
+						  false);
 			}
-		} else {
-			if (strcasecmp(key, "ok") != 0)
-				if (manager->event_cb)
-					manager->event_cb(pkg_type,
-							  pkg_name, event_type,
-							  PACAKGE_MANAGER_EVENT_STATE_FAILED,
-							  0,
-							  PACKAGE_MANAGER_ERROR_NONE,
-							  manager->user_data);
+			if (event_state == PACAKGE_MANAGER_EVENT_STATE_FAILED)
+				error = info && info->error ? info->error :
+				    PACKAGE_MANAGER_ERROR_IO_ERROR;
+			else
+				event_state = PACAKGE_MANAGER_EVENT_STATE_COMPLETED;
+
+			__manager_deliver(manager, pkg_type, pkg_name,
+					  event_type, event_state, 100,
+					  error, true);
+
+			__remove_event_info(&(manager->head), req_id);
+		} else if (strcasecmp(val, "ok") != 0) {
+			__manager_deliver(manager, pkg_type, pkg_name,
+					  event_type,
+					  PACAKGE_MANAGER_EVENT_STATE_FAILED,
+					  0, PACKAGE_MANAGER_ERROR_IO_ERROR,
+					  false);
+			if (listeners && listeners->data == manager)
+				__journal_record(pkg_type, pkg_name,
+						 PACAKGE_MANAGER_EVENT_TYPE_UPDATE,
+						 PACAKGE_MANAGER_EVENT_STATE_FAILED,
+						 PACKAGE_MANAGER_ERROR_IO_ERROR);
+		} else if (listeners && listeners->data == manager) {
+			/*
+			 * The start was missed, so the kind of change is not
+			 * known, but the package set did change
+			 */
+			__journal_record(pkg_type, pkg_name,
+					 PACAKGE_MANAGER_EVENT_TYPE_UPDATE,
+					 PACAKGE_MANAGER_EVENT_STATE_COMPLETED,
+					 PACKAGE_MANAGER_ERROR_NONE);
 		}
 	}
 
 	return PACKAGE_MANAGER_ERROR_NONE;
 }
 
+int __package_manager_listen(package_manager_h manager)
+{
+	int ret;
+
+	if (manager->listening)
+		return PACKAGE_MANAGER_ERROR_NONE;
+
+	/* Read the events of another process if it publishes them */
+	if (manager->bus_mode == PACKAGE_MANAGER_EVENT_BUS_ATTACH
+	    && __bus_attach(manager) == PACKAGE_MANAGER_ERROR_NONE) {
+		manager->listening = true;
+		listeners = g_slist_append(listeners, manager);
+		return PACKAGE_MANAGER_ERROR_NONE;
+	}
+
+	ret = pkgmgr_client_listen_status(manager->pc, global_event_handler,
+					  manager);
+	if (ret < 0) {
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_IO_ERROR,
+					  __FUNCTION__,
+					  "failed to listen to the package manager");
+	}
+
+	manager->listening = true;
+	listeners = g_slist_append(listeners, manager);
+
+	if (manager->bus_mode == PACKAGE_MANAGER_EVENT_BUS_PUBLISH)
+		__bus_start_publishing(manager);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+void __package_manager_fallback(package_manager_h manager)
+{
+	listeners = g_slist_remove(listeners, manager);
+	manager->listening = false;
+
+	if (__package_manager_listen(manager) != PACKAGE_MANAGER_ERROR_NONE)
+		LOGE("handle %d lost its package events", manager->handle_id);
+}
+
 int package_manager_set_event_cb(package_manager_h manager,
 				 package_manager_event_cb callback,
 				 void *user_data)
 {
-	int ret = 0;
 	if (package_manager_valiate_handle(manager)) {
 		return
 		    package_manager_error
@@ -647,15 +1481,37 @@ int package_manager_set_event_cb(package_manager_h manager,
 	manager->event_cb = callback;
 	manager->user_data = user_data;
 
-	ret =
-	    pkgmgr_client_listen_status(manager->pc, global_event_handler,
-					manager);
+	return __package_manager_listen(manager);
+}
+
+int package_manager_set_event_bus(package_manager_h manager,
+				  package_manager_event_bus_e mode)
+{
+	if (package_manager_valiate_handle(manager) || manager->listening
+	    || mode < PACKAGE_MANAGER_EVENT_BUS_NONE
+	    || mode > PACKAGE_MANAGER_EVENT_BUS_ATTACH) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	manager->bus_mode = mode;
 
 	return PACKAGE_MANAGER_ERROR_NONE;
 }
 
 int package_manager_unset_event_cb(package_manager_h manager)
 {
-	// TODO: Please implement this function.
+	if (package_manager_valiate_handle(manager)) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	manager->event_cb = NULL;
+	manager->user_data = NULL;
+
 	return PACKAGE_MANAGER_ERROR_NONE;
-}
\ No newline at end of file
+}
@@ -0,0 +1,933 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <glib.h>
+#include <dlog.h>
+
+#include <package_manager_private.h>
+
+#define ARCHIVE_MANIFEST_MAX (1024 * 1024)
+#define ARCHIVE_HEADER_MAX (16 * 1024 * 1024)
+
+#define ZIP_EOCD_SIG 0x06054b50
+#define ZIP_EOCD_LEN 22
+#define ZIP64_LOCATOR_SIG 0x07064b50
+#define ZIP64_LOCATOR_LEN 20
+#define ZIP64_EOCD_SIG 0x06064b50
+#define ZIP64_EOCD_LEN 56
+#define ZIP_CENTRAL_SIG 0x02014b50
+#define ZIP_CENTRAL_LEN 46
+#define ZIP_LOCAL_SIG 0x04034b50
+#define ZIP_LOCAL_LEN 30
+#define ZIP_ZIP64_EXTRA 0x0001
+#define ZIP_FLAG_ENCRYPTED 0x0001
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATED 8
+
+#define RPM_LEAD_LEN 96
+#define RPM_HEADER_LEN 16
+#define RPM_TAG_NAME 1000
+#define RPM_TAG_VERSION 1001
+#define RPM_TAG_RELEASE 1002
+#define RPM_TAG_SIZE 1009
+#define RPM_TAG_LONGSIZE 5009
+#define RPM_TYPE_INT32 4
+#define RPM_TYPE_INT64 5
+#define RPM_TYPE_STRING 6
+
+#define TIZEN_WIDGET_NS "http://tizen.org/ns/widgets"
+
+/*
+ * Only the parts of an archive that are needed are read: for zip based
+ * packages the end record, the central directory and the manifest entry;
+ * for rpm packages the headers at the start of the file. Archives are not
+ * mapped, so packages larger than the address space of 32 bit targets can
+ * be inspected as well.
+ */
+typedef struct _archive {
+	int fd;
+	unsigned long long size;
+} archive;
+
+typedef struct _zip_entry {
+	int method;
+	int flags;
+	unsigned long long csize;
+	unsigned long long usize;
+	unsigned long long offset;
+} zip_entry;
+
+typedef struct _archive_manifest {
+	const char *name;
+	const char *type;
+} archive_manifest;
+
+/* In order of precedence, hybrid web packages also carry a native one */
+static const archive_manifest manifests[] = {
+	{"config.xml", "wgt"},
+	{"tizen-manifest.xml", "tpk"},
+	{"info/manifest.xml", "tpk"},
+};
+
+#define MANIFEST_COUNT (sizeof(manifests) / sizeof(manifests[0]))
+
+struct package_manager_archive_info_s {
+	char *type;
+	char *package;
+	char *version;
+	unsigned long long size;
+	char **dependencies;
+	int dependency_count;
+};
+
+static unsigned int __get_le16(const unsigned char *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static unsigned int __get_le32(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+static unsigned long long __get_le64(const unsigned char *p)
+{
+	return __get_le32(p) | (unsigned long long)__get_le32(p + 4) << 32;
+}
+
+static unsigned int __get_be32(const unsigned char *p)
+{
+	return (unsigned int)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static unsigned long long __get_be64(const unsigned char *p)
+{
+	return (unsigned long long)__get_be32(p) << 32 | __get_be32(p + 4);
+}
+
+/* Whether [offset, offset + len) lies within size bytes */
+static bool __span_has(unsigned long long size, unsigned long long offset,
+		       unsigned long long len)
+{
+	return offset <= size && len <= size - offset;
+}
+
+static bool __archive_has(const archive *a, unsigned long long offset,
+			  unsigned long long len)
+{
+	return __span_has(a->size, offset, len);
+}
+
+static bool __archive_read(const archive *a, unsigned long long offset,
+			   void *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	if (!__archive_has(a, offset, len))
+		return false;
+
+	while (done < len) {
+		n = pread(a->fd, (char *)buf + done, len - done,
+			  offset + done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+
+	return true;
+}
+
+/* Reads a bounded part of the archive into a new buffer */
+static unsigned char *__archive_load(const archive *a,
+				     unsigned long long offset,
+				     unsigned long long len)
+{
+	unsigned char *buf;
+
+	if (len > ARCHIVE_HEADER_MAX)
+		return NULL;
+
+	buf = malloc(len + 1);
+	if (buf == NULL)
+		return NULL;
+
+	if (!__archive_read(a, offset, buf, len)) {
+		free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+static int __archive_open(const char *path, archive *a)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return -1;
+	}
+
+	/* Only a few scattered blocks are ever read */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+	a->fd = fd;
+	a->size = st.st_size;
+
+	return 0;
+}
+
+static void __archive_close(archive *a)
+{
+	close(a->fd);
+}
+
+static bool __is_rpm(const archive *a)
+{
+	static const unsigned char magic[] = { 0xed, 0xab, 0xee, 0xdb };
+	unsigned char lead[4];
+
+	return a->size >= RPM_LEAD_LEN && __archive_read(a, 0, lead, 4)
+	    && memcmp(lead, magic, 4) == 0;
+}
+
+static bool __zip_find_central(const archive *a, unsigned long long *offset,
+			       unsigned long long *size,
+			       unsigned long long *count)
+{
+	unsigned char record[ZIP64_EOCD_LEN];
+	const unsigned char *p;
+	unsigned char *tail;
+	unsigned long long start;
+	unsigned long long eocd;
+	unsigned long long zip64;
+	size_t len;
+	size_t i;
+
+	if (a->size < ZIP_EOCD_LEN)
+		return false;
+
+	/* The end record is followed by a comment of up to 64k */
+	start = a->size > ZIP_EOCD_LEN + 0xffff ?
+	    a->size - ZIP_EOCD_LEN - 0xffff : 0;
+	len = a->size - start;
+	tail = __archive_load(a, start, len);
+	if (tail == NULL)
+		return false;
+
+	for (i = len - ZIP_EOCD_LEN;; i--) {
+		p = tail + i;
+		if (__get_le32(p) == ZIP_EOCD_SIG
+		    && i + ZIP_EOCD_LEN + __get_le16(p + 20) <= len)
+			break;
+		if (i == 0) {
+			free(tail);
+			return false;
+		}
+	}
+
+	eocd = start + i;
+	*count = __get_le16(p + 10);
+	*size = __get_le32(p + 12);
+	*offset = __get_le32(p + 16);
+	free(tail);
+
+	if (*count == 0xffff || *size == 0xffffffff
+	    || *offset == 0xffffffff) {
+		if (eocd < ZIP64_LOCATOR_LEN
+		    || !__archive_read(a, eocd - ZIP64_LOCATOR_LEN, record,
+				       ZIP64_LOCATOR_LEN)
+		    || __get_le32(record) != ZIP64_LOCATOR_SIG)
+			return false;
+
+		zip64 = __get_le64(record + 8);
+		if (!__archive_read(a, zip64, record, ZIP64_EOCD_LEN)
+		    || __get_le32(record) != ZIP64_EOCD_SIG)
+			return false;
+
+		*count = __get_le64(record + 32);
+		*size = __get_le64(record + 40);
+		*offset = __get_le64(record + 48);
+	}
+
+	return __archive_has(a, *offset, *size);
+}
+
+static bool __zip_entry_zip64(const unsigned char *extra, unsigned int len,
+			      zip_entry *entry)
+{
+	unsigned int id;
+	unsigned int size;
+	unsigned int pos;
+
+	while (len >= 4) {
+		id = __get_le16(extra);
+		size = __get_le16(extra + 2);
+		if (size > len - 4)
+			return false;
+
+		if (id == ZIP_ZIP64_EXTRA) {
+			/* Only the fields saturated in the record are present */
+			pos = 4;
+			if (entry->usize == 0xffffffff) {
+				if (pos + 8 > size + 4)
+					return false;
+				entry->usize = __get_le64(extra + pos);
+				pos += 8;
+			}
+			if (entry->csize == 0xffffffff) {
+				if (pos + 8 > size + 4)
+					return false;
+				entry->csize = __get_le64(extra + pos);
+				pos += 8;
+			}
+			if (entry->offset == 0xffffffff) {
+				if (pos + 8 > size + 4)
+					return false;
+				entry->offset = __get_le64(extra + pos);
+			}
+			return true;
+		}
+
+		extra += 4 + size;
+		len -= 4 + size;
+	}
+
+	return true;
+}
+
+/*
+ * Walks the central directory, adding up the uncompressed sizes and
+ * picking the manifest with the highest precedence.
+ */
+static bool __zip_scan(const archive *a, unsigned long long *total,
+		       const archive_manifest **manifest, zip_entry *found)
+{
+	const unsigned char *p;
+	unsigned char *central;
+	unsigned long long offset;
+	unsigned long long size;
+	unsigned long long count;
+	unsigned long long pos = 0;
+	unsigned long long n;
+	unsigned int name_len;
+	unsigned int extra_len;
+	unsigned int comment_len;
+	size_t rank = MANIFEST_COUNT;
+	zip_entry entry;
+	size_t i;
+
+	if (!__zip_find_central(a, &offset, &size, &count))
+		return false;
+
+	/* Read at once, it is small next to the entries it describes */
+	central = __archive_load(a, offset, size);
+	if (central == NULL)
+		return false;
+
+	*total = 0;
+	*manifest = NULL;
+
+	for (n = 0; n < count; n++) {
+		if (!__span_has(size, pos, ZIP_CENTRAL_LEN))
+			goto err;
+		p = central + pos;
+		if (__get_le32(p) != ZIP_CENTRAL_SIG)
+			goto err;
+
+		name_len = __get_le16(p + 28);
+		extra_len = __get_le16(p + 30);
+		comment_len = __get_le16(p + 32);
+		if (!__span_has(size, pos + ZIP_CENTRAL_LEN,
+				name_len + extra_len + comment_len))
+			goto err;
+
+		entry.flags = __get_le16(p + 8);
+		entry.method = __get_le16(p + 10);
+		entry.csize = __get_le32(p + 20);
+		entry.usize = __get_le32(p + 24);
+		entry.offset = __get_le32(p + 42);
+		if (!__zip_entry_zip64(p + ZIP_CENTRAL_LEN + name_len,
+				       extra_len, &entry))
+			goto err;
+
+		*total += entry.usize;
+
+		for (i = 0; i < rank; i++) {
+			if (strlen(manifests[i].name) == name_len
+			    && memcmp(p + ZIP_CENTRAL_LEN, manifests[i].name,
+				      name_len) == 0) {
+				rank = i;
+				*manifest = &manifests[i];
+				*found = entry;
+				break;
+			}
+		}
+
+		pos += ZIP_CENTRAL_LEN + name_len + extra_len + comment_len;
+	}
+
+	free(central);
+
+	return true;
+
+ err:
+	free(central);
+	return false;
+}
+
+static char *__zip_read(const archive *a, const zip_entry *entry,
+			size_t *len)
+{
+	unsigned char local[ZIP_LOCAL_LEN];
+	unsigned char *data;
+	unsigned long long start;
+	z_stream stream;
+	char *buf;
+	int ret;
+
+	if (entry->flags & ZIP_FLAG_ENCRYPTED
+	    || entry->usize > ARCHIVE_MANIFEST_MAX
+	    || entry->csize > ARCHIVE_MANIFEST_MAX
+	    || !__archive_read(a, entry->offset, local, ZIP_LOCAL_LEN))
+		return NULL;
+
+	if (__get_le32(local) != ZIP_LOCAL_SIG)
+		return NULL;
+
+	start = entry->offset + ZIP_LOCAL_LEN + __get_le16(local + 26) +
+	    __get_le16(local + 28);
+	data = __archive_load(a, start, entry->csize);
+	if (data == NULL)
+		return NULL;
+
+	buf = malloc(entry->usize + 1);
+	if (buf == NULL)
+		goto err;
+
+	switch (entry->method) {
+	case ZIP_METHOD_STORED:
+		if (entry->csize != entry->usize)
+			goto err;
+		memcpy(buf, data, entry->usize);
+		break;
+
+	case ZIP_METHOD_DEFLATED:
+		memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+			goto err;
+
+		stream.next_in = (Bytef *)data;
+		stream.avail_in = entry->csize;
+		stream.next_out = (Bytef *)buf;
+		stream.avail_out = entry->usize;
+
+		ret = inflate(&stream, Z_FINISH);
+		inflateEnd(&stream);
+		if (ret != Z_STREAM_END || stream.total_out != entry->usize)
+			goto err;
+		break;
+
+	default:
+		goto err;
+	}
+
+	free(data);
+
+	buf[entry->usize] = '\0';
+	*len = entry->usize;
+
+	return buf;
+
+ err:
+	free(data);
+	free(buf);
+	return NULL;
+}
+
+static char *__xml_prop(xmlNodePtr node, const char *name)
+{
+	xmlChar *value;
+	char *prop;
+
+	value = xmlGetProp(node, (const xmlChar *)name);
+	if (value == NULL)
+		return NULL;
+
+	prop = strdup((const char *)value);
+	xmlFree(value);
+
+	return prop;
+}
+
+static char *__xml_child_text(xmlNodePtr node, const char *name)
+{
+	xmlChar *value;
+	char *text;
+
+	for (node = node->children; node; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE
+		    || xmlStrcmp(node->name, (const xmlChar *)name) != 0)
+			continue;
+
+		value = xmlNodeGetContent(node);
+		if (value == NULL)
+			return NULL;
+
+		text = strdup((const char *)value);
+		xmlFree(value);
+		return text;
+	}
+
+	return NULL;
+}
+
+static void __parse_widget(xmlNodePtr root,
+			   struct package_manager_archive_info_s *info)
+{
+	xmlNodePtr node;
+
+	info->version = __xml_prop(root, "version");
+
+	for (node = root->children; node; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE || node->ns == NULL
+		    || xmlStrcmp(node->ns->href,
+				 (const xmlChar *)TIZEN_WIDGET_NS) != 0
+		    || xmlStrcmp(node->name, (const xmlChar *)"application"))
+			continue;
+
+		info->package = __xml_prop(node, "package");
+		return;
+	}
+}
+
+/* Packages required by <dependencies><dependency type="requires"> */
+static void __parse_dependencies(xmlNodePtr root,
+				 struct package_manager_archive_info_s *info)
+{
+	xmlNodePtr node;
+	xmlNodePtr dependency;
+	xmlChar *type;
+	char *package;
+	char **dependencies;
+	bool requires;
+
+	for (node = root->children; node; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE
+		    || xmlStrcmp(node->name, (const xmlChar *)"dependencies"))
+			continue;
+
+		for (dependency = node->children; dependency;
+		     dependency = dependency->next) {
+			if (dependency->type != XML_ELEMENT_NODE
+			    || xmlStrcmp(dependency->name,
+					 (const xmlChar *)"dependency"))
+				continue;
+
+			type = xmlGetProp(dependency, (const xmlChar *)"type");
+			requires = type == NULL
+			    || xmlStrcmp(type, (const xmlChar *)"requires") == 0;
+			xmlFree(type);
+			if (!requires)
+				continue;
+
+			package = (char *)xmlNodeGetContent(dependency);
+			if (package == NULL)
+				continue;
+
+			dependencies = realloc(info->dependencies,
+					       (info->dependency_count + 1) *
+					       sizeof(char *));
+			if (dependencies == NULL) {
+				xmlFree(package);
+				return;
+			}
+			info->dependencies = dependencies;
+
+			dependencies[info->dependency_count] =
+			    strdup(g_strstrip(package));
+			xmlFree(package);
+			if (dependencies[info->dependency_count] == NULL)
+				return;
+			info->dependency_count++;
+		}
+	}
+}
+
+static int __parse_manifest(const char *buf, size_t len,
+			    struct package_manager_archive_info_s *info)
+{
+	xmlDocPtr doc;
+	xmlNodePtr root;
+
+	/* No network access and no entity expansion for untrusted input */
+	doc = xmlReadMemory(buf, len, NULL, NULL,
+			    XML_PARSE_NONET | XML_PARSE_NOERROR |
+			    XML_PARSE_NOWARNING);
+	if (doc == NULL)
+		return -1;
+
+	root = xmlDocGetRootElement(doc);
+	if (root == NULL) {
+		xmlFreeDoc(doc);
+		return -1;
+	}
+
+	if (xmlStrcmp(root->name, (const xmlChar *)"widget") == 0) {
+		__parse_widget(root, info);
+	} else if (xmlStrcmp(root->name, (const xmlChar *)"manifest") == 0) {
+		info->package = __xml_prop(root, "package");
+		info->version = __xml_prop(root, "version");
+		__parse_dependencies(root, info);
+	} else if (xmlStrcmp(root->name, (const xmlChar *)"Manifest") == 0) {
+		/* Legacy native packages */
+		info->package = __xml_child_text(root, "Id");
+		info->version = __xml_child_text(root, "Version");
+	}
+
+	xmlFreeDoc(doc);
+
+	return 0;
+}
+
+static int __zip_info(const archive *a,
+		      struct package_manager_archive_info_s *info)
+{
+	const archive_manifest *manifest;
+	zip_entry entry;
+	char *buf;
+	size_t len;
+	int ret;
+
+	if (!__zip_scan(a, &info->size, &manifest, &entry)
+	    || manifest == NULL)
+		return -1;
+
+	info->type = strdup(manifest->type);
+	if (info->type == NULL)
+		return -1;
+
+	buf = __zip_read(a, &entry, &len);
+	if (buf == NULL) {
+		LOGE("failed to read %s", manifest->name);
+		return -1;
+	}
+
+	ret = __parse_manifest(buf, len, info);
+	free(buf);
+
+	return ret;
+}
+
+static bool __rpm_header(const archive *a, unsigned long long offset,
+			 unsigned int *count, unsigned int *size)
+{
+	static const unsigned char magic[] = { 0x8e, 0xad, 0xe8, 0x01 };
+	unsigned char header[RPM_HEADER_LEN];
+
+	if (!__archive_read(a, offset, header, RPM_HEADER_LEN)
+	    || memcmp(header, magic, 4) != 0)
+		return false;
+
+	*count = __get_be32(header + 8);
+	*size = __get_be32(header + 12);
+
+	return __archive_has(a, offset + RPM_HEADER_LEN,
+			     (unsigned long long)*count * 16 + *size);
+}
+
+static int __rpm_info(const archive *a,
+		      struct package_manager_archive_info_s *info)
+{
+	unsigned char *index;
+	const unsigned char *store;
+	const char *name = NULL;
+	const char *version = NULL;
+	const char *release = NULL;
+	unsigned long long offset;
+	unsigned int count;
+	unsigned int size;
+	unsigned int tag;
+	unsigned int type;
+	unsigned int at;
+	unsigned int i;
+
+	/* The signature header is padded to 8 bytes */
+	offset = RPM_LEAD_LEN;
+	if (!__rpm_header(a, offset, &count, &size))
+		return -1;
+	offset += RPM_HEADER_LEN + (unsigned long long)count * 16 + size;
+	offset = (offset + 7) & ~7ULL;
+
+	if (!__rpm_header(a, offset, &count, &size))
+		return -1;
+
+	index = __archive_load(a, offset + RPM_HEADER_LEN,
+			       (unsigned long long)count * 16 + size);
+	if (index == NULL)
+		return -1;
+	store = index + (unsigned long long)count * 16;
+
+	for (i = 0; i < count; i++) {
+		tag = __get_be32(index + i * 16);
+		type = __get_be32(index + i * 16 + 4);
+		at = __get_be32(index + i * 16 + 8);
+		if (at >= size)
+			continue;
+
+		if (type == RPM_TYPE_STRING) {
+			/* Strings must be terminated within the store */
+			if (memchr(store + at, '\0', size - at) == NULL)
+				continue;
+			if (tag == RPM_TAG_NAME)
+				name = (const char *)store + at;
+			else if (tag == RPM_TAG_VERSION)
+				version = (const char *)store + at;
+			else if (tag == RPM_TAG_RELEASE)
+				release = (const char *)store + at;
+		} else if (tag == RPM_TAG_SIZE && type == RPM_TYPE_INT32
+			   && size - at >= 4 && info->size == 0) {
+			info->size = __get_be32(store + at);
+		} else if (tag == RPM_TAG_LONGSIZE && type == RPM_TYPE_INT64
+			   && size - at >= 8) {
+			info->size = __get_be64(store + at);
+		}
+	}
+
+	info->type = strdup("rpm");
+	if (name)
+		info->package = strdup(name);
+	if (version && release) {
+		info->version = malloc(strlen(version) + strlen(release) + 2);
+		if (info->version)
+			sprintf(info->version, "%s-%s", version, release);
+	} else if (version) {
+		info->version = strdup(version);
+	}
+
+	free(index);
+
+	return info->type ? 0 : -1;
+}
+
+const char *__archive_detect_type(const char *path)
+{
+	const archive_manifest *manifest = NULL;
+	unsigned long long total;
+	zip_entry entry;
+	archive a;
+
+	if (path == NULL || __archive_open(path, &a) < 0)
+		return NULL;
+
+	if (__is_rpm(&a)) {
+		__archive_close(&a);
+		return "rpm";
+	}
+
+	if (!__zip_scan(&a, &total, &manifest, &entry))
+		manifest = NULL;
+
+	__archive_close(&a);
+
+	return manifest ? manifest->type : NULL;
+}
+
+int package_manager_archive_info_destroy(package_manager_archive_info_h info)
+{
+	if (info == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	while (info->dependency_count > 0)
+		free(info->dependencies[--info->dependency_count]);
+	free(info->dependencies);
+	free(info->type);
+	free(info->package);
+	free(info->version);
+	free(info);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_get_archive_info(const char *path,
+				     package_manager_archive_info_h *info)
+{
+	struct package_manager_archive_info_s *archive_info;
+	archive a;
+	int ret;
+
+	if (path == NULL || info == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	archive_info = calloc(1, sizeof(struct package_manager_archive_info_s));
+	if (archive_info == NULL) {
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY,
+					  __FUNCTION__,
+					  "failed to create an archive info handle");
+	}
+
+	if (__archive_open(path, &a) < 0) {
+		free(archive_info);
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_IO_ERROR,
+					  __FUNCTION__,
+					  "failed to open the archive");
+	}
+
+	if (__is_rpm(&a))
+		ret = __rpm_info(&a, archive_info);
+	else
+		ret = __zip_info(&a, archive_info);
+
+	__archive_close(&a);
+
+	if (ret < 0 || archive_info->package == NULL) {
+		package_manager_archive_info_destroy(archive_info);
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_IO_ERROR,
+					  __FUNCTION__,
+					  "not a valid package archive");
+	}
+
+	*info = archive_info;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+static int __archive_info_get(const char *value, char **out,
+			      const char *function)
+{
+	if (out == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, function, NULL);
+	}
+
+	*out = NULL;
+	if (value == NULL)
+		return PACKAGE_MANAGER_ERROR_NONE;
+
+	*out = strdup(value);
+	if (*out == NULL) {
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY,
+					  function, NULL);
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_archive_info_get_type(package_manager_archive_info_h info,
+					  char **type)
+{
+	if (info == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	return __archive_info_get(info->type, type, __FUNCTION__);
+}
+
+int package_manager_archive_info_get_package(package_manager_archive_info_h info,
+					     char **package)
+{
+	if (info == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	return __archive_info_get(info->package, package, __FUNCTION__);
+}
+
+int package_manager_archive_info_get_version(package_manager_archive_info_h info,
+					     char **version)
+{
+	if (info == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	return __archive_info_get(info->version, version, __FUNCTION__);
+}
+
+int package_manager_archive_info_get_size(package_manager_archive_info_h info,
+					  unsigned long long *size)
+{
+	if (info == NULL || size == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	*size = info->size;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_archive_info_foreach_dependency(package_manager_archive_info_h info,
+						    package_manager_archive_dependency_cb callback,
+						    void *user_data)
+{
+	int i;
+
+	if (info == NULL || callback == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	for (i = 0; i < info->dependency_count; i++) {
+		if (!callback(info->dependencies[i], user_data))
+			break;
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
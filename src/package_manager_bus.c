@@ -0,0 +1,696 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+#include <glib.h>
+#include <dlog.h>
+
+#include <package_manager_private.h>
+
+#define BUS_SOCKET_NAME "capi-appfw-package-manager.events"
+#define BUS_MAGIC 0x504d4542	/* "PMEB" */
+#define BUS_VERSION 1
+#define BUS_SIZE 512		/* must be a power of two */
+#define BUS_MASK (BUS_SIZE - 1)
+#define BUS_TYPE_LEN 32
+#define BUS_NAME_LEN 128
+#define BUS_WAIT_MS 1000
+#define BUS_MAX_CLIENTS 64
+#define BUS_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+/*
+ * One process publishes the package events it decodes into a ring kept in
+ * a sealed memfd. The ring has a single writer, and each entry is guarded
+ * by its own sequence number like the journal, so readers never lock it.
+ *
+ * Other processes of the same user get a read only descriptor of the memfd
+ * from an abstract unix socket. Its writes are sealed once the publisher
+ * has mapped it, so they cannot map it writable by reopening it either.
+ * They block on the ring sequence with a futex from a reader thread,
+ * which only wakes up the main loop to deliver the new entries. The socket
+ * stays connected, so readers notice when the publisher goes away and fall
+ * back to listening directly.
+ */
+typedef struct _bus_entry {
+	volatile unsigned int seq;
+	char type[BUS_TYPE_LEN];
+	char package[BUS_NAME_LEN];
+	int event_type;
+	int event_state;
+	int progress;
+	int error;
+	int end;
+} bus_entry;
+
+typedef struct _bus_ring {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int size;
+	volatile unsigned int seq;	/* last published entry, futex word */
+	bus_entry entries[BUS_SIZE];
+} bus_ring;
+
+typedef struct _bus_client {
+	int fd;
+	GIOChannel *channel;
+	guint watch;
+} bus_client;
+
+typedef struct _bus_reader {
+	int refcount;		/* main loop, reader thread, pending drain */
+	volatile int stopping;
+	volatile int scheduled;
+	bus_ring *ring;
+	unsigned int seq;	/* last entry delivered */
+	int fd;			/* connection to the publisher */
+	GIOChannel *channel;
+	guint watch;
+} bus_reader;
+
+static struct {
+	package_manager_h manager;
+	int memfd;
+	int rofd;		/* read only, sent to the readers */
+	bus_ring *ring;
+	int fd;
+	GIOChannel *channel;
+	guint watch;
+	GSList *clients;
+} publisher = {
+	.memfd = -1,
+	.rofd = -1,
+	.fd = -1,
+};
+
+static bus_reader *reader;
+static GSList *readers;		/* handles attached to the reader */
+
+static int __futex(volatile unsigned int *addr, int op, unsigned int val,
+		   const struct timespec *timeout)
+{
+	return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+static void __bus_address(struct sockaddr_un *addr, socklen_t *len)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	/* Abstract name, the leading byte stays 0 */
+	memcpy(addr->sun_path + 1, BUS_SOCKET_NAME, strlen(BUS_SOCKET_NAME));
+	*len = offsetof(struct sockaddr_un, sun_path) + 1 +
+	    strlen(BUS_SOCKET_NAME);
+}
+
+void __bus_publish(package_manager_h manager, const char *pkg_type,
+		   const char *pkg_name,
+		   package_manager_event_type_e event_type,
+		   package_manager_event_state_e event_state, int progress,
+		   package_manager_error_e error, bool end)
+{
+	bus_ring *ring = publisher.ring;
+	bus_entry *entry;
+	unsigned int seq;
+
+	if (manager != publisher.manager || ring == NULL)
+		return;
+
+	seq = ring->seq + 1;
+	entry = &ring->entries[seq & BUS_MASK];
+
+	entry->seq = 0;
+	__sync_synchronize();
+
+	snprintf(entry->type, sizeof(entry->type), "%s",
+		 pkg_type ? pkg_type : "");
+	snprintf(entry->package, sizeof(entry->package), "%s",
+		 pkg_name ? pkg_name : "");
+	entry->event_type = event_type;
+	entry->event_state = event_state;
+	entry->progress = progress;
+	entry->error = error;
+	entry->end = end;
+
+	__sync_synchronize();
+	entry->seq = seq;
+	__sync_synchronize();
+	ring->seq = seq;
+	__sync_synchronize();
+
+	__futex(&ring->seq, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+static void __client_free(bus_client *client)
+{
+	if (client->watch)
+		g_source_remove(client->watch);
+	g_io_channel_unref(client->channel);
+	close(client->fd);
+	free(client);
+}
+
+static gboolean __client_gone(GIOChannel *channel, GIOCondition cond,
+			      gpointer data)
+{
+	bus_client *client = data;
+
+	publisher.clients = g_slist_remove(publisher.clients, client);
+	client->watch = 0;
+	__client_free(client);
+
+	return FALSE;
+}
+
+static int __send_ring(int fd)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char buf[CMSG_SPACE(sizeof(int))];
+	char version = BUS_VERSION;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(buf, 0, sizeof(buf));
+
+	iov.iov_base = &version;
+	iov.iov_len = sizeof(version);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = buf;
+	msg.msg_controllen = sizeof(buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &publisher.rofd, sizeof(int));
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(version))
+		return -1;
+
+	return 0;
+}
+
+static gboolean __publisher_accept(GIOChannel *channel, GIOCondition cond,
+				   gpointer data)
+{
+	bus_client *client;
+	struct ucred cred;
+	socklen_t len;
+	int fd;
+
+	fd = accept4(publisher.fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd < 0)
+		return TRUE;
+
+	len = sizeof(cred);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0
+	    || (cred.uid != 0 && cred.uid != getuid())) {
+		LOGE("refusing the events to process %d", (int)cred.pid);
+		close(fd);
+		return TRUE;
+	}
+
+	if (g_slist_length(publisher.clients) >= BUS_MAX_CLIENTS) {
+		LOGE("too many event readers");
+		close(fd);
+		return TRUE;
+	}
+
+	if (__send_ring(fd) < 0) {
+		LOGE("failed to send the event ring");
+		close(fd);
+		return TRUE;
+	}
+
+	client = calloc(1, sizeof(bus_client));
+	if (client == NULL) {
+		close(fd);
+		return TRUE;
+	}
+
+	/* Kept open so that the reader notices when we go away */
+	client->fd = fd;
+	client->channel = g_io_channel_unix_new(fd);
+	client->watch = g_io_add_watch(client->channel,
+				       G_IO_IN | G_IO_HUP | G_IO_ERR,
+				       __client_gone, client);
+	publisher.clients = g_slist_prepend(publisher.clients, client);
+
+	return TRUE;
+}
+
+void __bus_stop_publishing(package_manager_h manager)
+{
+	bus_client *client;
+
+	if (manager != publisher.manager)
+		return;
+
+	while (publisher.clients) {
+		client = publisher.clients->data;
+		publisher.clients = g_slist_remove(publisher.clients, client);
+		__client_free(client);
+	}
+
+	if (publisher.watch)
+		g_source_remove(publisher.watch);
+	if (publisher.channel)
+		g_io_channel_unref(publisher.channel);
+	if (publisher.fd >= 0)
+		close(publisher.fd);
+	if (publisher.ring)
+		munmap(publisher.ring, sizeof(bus_ring));
+	if (publisher.rofd >= 0)
+		close(publisher.rofd);
+	if (publisher.memfd >= 0)
+		close(publisher.memfd);
+
+	memset(&publisher, 0, sizeof(publisher));
+	publisher.memfd = -1;
+	publisher.rofd = -1;
+	publisher.fd = -1;
+}
+
+void __bus_start_publishing(package_manager_h manager)
+{
+	struct sockaddr_un addr;
+	socklen_t len;
+	char path[32];
+
+	if (publisher.manager) {
+		LOGE("the events are already published by handle %d",
+		     publisher.manager->handle_id);
+		return;
+	}
+
+	publisher.manager = manager;
+
+	publisher.memfd = memfd_create("package-manager-events",
+				       MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (publisher.memfd < 0) {
+		LOGE("failed to create the event ring");
+		goto err;
+	}
+
+	if (ftruncate(publisher.memfd, sizeof(bus_ring)) < 0) {
+		LOGE("failed to size the event ring");
+		goto err;
+	}
+
+	publisher.ring = mmap(NULL, sizeof(bus_ring), PROT_READ | PROT_WRITE,
+			      MAP_SHARED, publisher.memfd, 0);
+	if (publisher.ring == MAP_FAILED) {
+		publisher.ring = NULL;
+		LOGE("failed to map the event ring");
+		goto err;
+	}
+
+	/*
+	 * Sealed so that readers can trust the size of their mapping, and
+	 * so that only the mapping above can write to it. Kernels older
+	 * than 5.1 lack the write seal, the read only descriptor still
+	 * keeps the readers from writing there.
+	 */
+	if (fcntl(publisher.memfd, F_ADD_SEALS,
+		  BUS_SEALS | F_SEAL_FUTURE_WRITE) < 0
+	    && fcntl(publisher.memfd, F_ADD_SEALS, BUS_SEALS) < 0) {
+		LOGE("failed to seal the event ring");
+		goto err;
+	}
+
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", publisher.memfd);
+	publisher.rofd = open(path, O_RDONLY | O_CLOEXEC);
+	if (publisher.rofd < 0) {
+		LOGE("failed to open the event ring read only");
+		goto err;
+	}
+
+	publisher.ring->magic = BUS_MAGIC;
+	publisher.ring->version = BUS_VERSION;
+	publisher.ring->size = BUS_SIZE;
+
+	publisher.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC |
+			      SOCK_NONBLOCK, 0);
+	if (publisher.fd < 0)
+		goto err;
+
+	__bus_address(&addr, &len);
+	if (bind(publisher.fd, (struct sockaddr *)&addr, len) < 0) {
+		LOGI("another process already publishes the events");
+		goto err;
+	}
+
+	if (listen(publisher.fd, SOMAXCONN) < 0)
+		goto err;
+
+	publisher.channel = g_io_channel_unix_new(publisher.fd);
+	publisher.watch = g_io_add_watch(publisher.channel, G_IO_IN,
+					 __publisher_accept, NULL);
+
+	return;
+
+ err:
+	__bus_stop_publishing(manager);
+}
+
+static void __reader_unref(bus_reader *r)
+{
+	if (__sync_sub_and_fetch(&r->refcount, 1) != 0)
+		return;
+
+	munmap(r->ring, sizeof(bus_ring));
+	free(r);
+}
+
+static bool __reader_copy(bus_ring *ring, unsigned int seq, bus_entry *copy)
+{
+	bus_entry *entry = &ring->entries[seq & BUS_MASK];
+
+	if (entry->seq != seq)
+		return false;
+	__sync_synchronize();
+	memcpy(copy, entry, sizeof(*copy));
+	__sync_synchronize();
+	if (entry->seq != seq)
+		return false;
+
+	copy->type[BUS_TYPE_LEN - 1] = '\0';
+	copy->package[BUS_NAME_LEN - 1] = '\0';
+
+	return true;
+}
+
+static void __reader_deliver(bus_reader *r)
+{
+	package_manager_h manager;
+	bus_entry copy;
+	GSList *targets;
+	GSList *l;
+	unsigned int last;
+
+	last = r->ring->seq;
+	__sync_synchronize();
+
+	if (last - r->seq > BUS_SIZE) {
+		LOGE("missed %u package events", last - r->seq - BUS_SIZE);
+		r->seq = last - BUS_SIZE;
+	}
+
+	while (r->seq != last && reader == r) {
+		r->seq++;
+		if (!__reader_copy(r->ring, r->seq, &copy))
+			continue;
+
+		/* Callbacks may destroy handles */
+		targets = g_slist_copy(readers);
+		for (l = targets; l; l = l->next) {
+			manager = l->data;
+			if (g_slist_find(readers, manager) == NULL)
+				continue;
+			__manager_deliver(manager, copy.type, copy.package,
+					  copy.event_type, copy.event_state,
+					  copy.progress, copy.error,
+					  copy.end);
+		}
+		g_slist_free(targets);
+	}
+}
+
+static gboolean __reader_drain(gpointer data)
+{
+	bus_reader *r = data;
+
+	r->scheduled = 0;
+	__sync_synchronize();
+
+	if (reader == r)
+		__reader_deliver(r);
+
+	__reader_unref(r);
+
+	return FALSE;
+}
+
+static void *__reader_main(void *data)
+{
+	bus_reader *r = data;
+	struct timespec timeout = {
+		.tv_sec = BUS_WAIT_MS / 1000,
+		.tv_nsec = (BUS_WAIT_MS % 1000) * 1000000L,
+	};
+	unsigned int seen = r->ring->seq;
+	unsigned int seq;
+
+	/* Wakes up now and then to notice that it has been stopped */
+	while (!r->stopping) {
+		seq = r->ring->seq;
+		if (seq == seen) {
+			__futex(&r->ring->seq, FUTEX_WAIT, seq, &timeout);
+			continue;
+		}
+
+		seen = seq;
+		if (__sync_bool_compare_and_swap(&r->scheduled, 0, 1)) {
+			__sync_add_and_fetch(&r->refcount, 1);
+			g_idle_add(__reader_drain, r);
+		}
+	}
+
+	__reader_unref(r);
+
+	return NULL;
+}
+
+static void __reader_stop(bool from_watch)
+{
+	bus_reader *r = reader;
+
+	reader = NULL;
+	r->stopping = 1;
+
+	if (!from_watch)
+		g_source_remove(r->watch);
+	g_io_channel_unref(r->channel);
+	close(r->fd);
+
+	__reader_unref(r);
+}
+
+static gboolean __reader_lost(GIOChannel *channel, GIOCondition cond,
+			      gpointer data)
+{
+	package_manager_h manager;
+	GSList *handles = readers;
+
+	LOGE("the event publisher went away, listening directly");
+
+	readers = NULL;
+	__reader_stop(true);
+
+	while (handles) {
+		manager = handles->data;
+		handles = g_slist_remove(handles, manager);
+		manager->attached = false;
+		__package_manager_fallback(manager);
+	}
+
+	return FALSE;
+}
+
+static int __receive_ring(int fd)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char buf[CMSG_SPACE(sizeof(int))];
+	char version;
+	int memfd = -1;
+
+	memset(&msg, 0, sizeof(msg));
+
+	iov.iov_base = &version;
+	iov.iov_len = sizeof(version);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = buf;
+	msg.msg_controllen = sizeof(buf);
+
+	if (recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) != sizeof(version))
+		return -1;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg && cmsg->cmsg_level == SOL_SOCKET
+	    && cmsg->cmsg_type == SCM_RIGHTS
+	    && cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+		memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+
+	if (memfd >= 0 && version != BUS_VERSION) {
+		close(memfd);
+		return -1;
+	}
+
+	return memfd;
+}
+
+static bus_ring *__map_ring(int memfd)
+{
+	struct stat st;
+	bus_ring *ring;
+	int seals;
+
+	seals = fcntl(memfd, F_GET_SEALS);
+	if (seals < 0 || (seals & BUS_SEALS) != BUS_SEALS)
+		return NULL;
+
+	if (fstat(memfd, &st) < 0 || st.st_size != sizeof(bus_ring))
+		return NULL;
+
+	ring = mmap(NULL, sizeof(bus_ring), PROT_READ, MAP_SHARED, memfd, 0);
+	if (ring == MAP_FAILED)
+		return NULL;
+
+	if (ring->magic != BUS_MAGIC || ring->version != BUS_VERSION
+	    || ring->size != BUS_SIZE) {
+		munmap(ring, sizeof(bus_ring));
+		return NULL;
+	}
+
+	return ring;
+}
+
+static int __reader_start(void)
+{
+	struct sockaddr_un addr;
+	struct timeval timeout = { .tv_sec = 1 };
+	struct ucred cred;
+	socklen_t len;
+	pthread_t thread;
+	bus_reader *r;
+	bus_ring *ring;
+	int memfd;
+	int fd;
+
+	/* Our own main loop would have to answer, just listen directly */
+	if (publisher.ring)
+		return PACKAGE_MANAGER_ERROR_IO_ERROR;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return PACKAGE_MANAGER_ERROR_IO_ERROR;
+
+	__bus_address(&addr, &len);
+	if (connect(fd, (struct sockaddr *)&addr, len) < 0) {
+		close(fd);
+		return PACKAGE_MANAGER_ERROR_IO_ERROR;
+	}
+
+	len = sizeof(cred);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0
+	    || (cred.uid != 0 && cred.uid != getuid())) {
+		LOGE("untrusted event publisher");
+		close(fd);
+		return PACKAGE_MANAGER_ERROR_IO_ERROR;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	memfd = __receive_ring(fd);
+	if (memfd < 0) {
+		close(fd);
+		return PACKAGE_MANAGER_ERROR_IO_ERROR;
+	}
+
+	ring = __map_ring(memfd);
+	close(memfd);
+	if (ring == NULL) {
+		LOGE("invalid event ring");
+		close(fd);
+		return PACKAGE_MANAGER_ERROR_IO_ERROR;
+	}
+
+	r = calloc(1, sizeof(bus_reader));
+	if (r == NULL) {
+		munmap(ring, sizeof(bus_ring));
+		close(fd);
+		return PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY;
+	}
+
+	r->refcount = 2;
+	r->ring = ring;
+	r->seq = ring->seq;
+	r->fd = fd;
+
+	if (pthread_create(&thread, NULL, __reader_main, r) != 0) {
+		munmap(ring, sizeof(bus_ring));
+		close(fd);
+		free(r);
+		return PACKAGE_MANAGER_ERROR_IO_ERROR;
+	}
+	pthread_detach(thread);
+
+	r->channel = g_io_channel_unix_new(fd);
+	r->watch = g_io_add_watch(r->channel, G_IO_IN | G_IO_HUP | G_IO_ERR,
+				  __reader_lost, NULL);
+
+	reader = r;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int __bus_attach(package_manager_h manager)
+{
+	int ret;
+
+	if (reader == NULL) {
+		ret = __reader_start();
+		if (ret != PACKAGE_MANAGER_ERROR_NONE)
+			return ret;
+	}
+
+	readers = g_slist_append(readers, manager);
+	manager->attached = true;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+void __bus_detach(package_manager_h manager)
+{
+	readers = g_slist_remove(readers, manager);
+	manager->attached = false;
+
+	if (readers == NULL && reader)
+		__reader_stop(false);
+}
@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <glib.h>
+#include <dlog.h>
+
+#include <package_manager_private.h>
+
+#define DISPATCH_MAX_THREADS 16
+#define DISPATCH_BATCH 16
+
+/*
+ * Events are queued on a strand per package. A strand exists only while
+ * it has events, sits on at most one worker queue at a time and its
+ * events are run one after the other, which keeps the events of a package
+ * in order. Strands are first queued on the worker their package hashes
+ * to; idle workers steal them from the others.
+ */
+typedef struct _dispatch_event {
+	package_manager_event_cb callback;
+	void *user_data;
+	char *pkg_type;
+	char *pkg_name;
+	package_manager_event_type_e event_type;
+	package_manager_event_state_e event_state;
+	int progress;
+	package_manager_error_e error;
+	struct _dispatch_event *next;
+} dispatch_event;
+
+typedef struct _dispatch_strand {
+	char *pkg_name;
+	dispatch_event *head;
+	dispatch_event *tail;
+	struct _dispatch_strand *next;
+} dispatch_strand;
+
+typedef struct _dispatch_worker {
+	package_manager_dispatcher_s *dispatcher;
+	int index;
+	pthread_t thread;
+	bool running;
+	pthread_mutex_t lock;
+	dispatch_strand *head;
+	dispatch_strand *tail;
+} dispatch_worker;
+
+struct package_manager_dispatcher_s {
+	int nr_workers;
+	dispatch_worker *workers;
+	pthread_mutex_t lock;	/* strands, their events and ready */
+	pthread_cond_t cond;
+	GHashTable *strands;
+	int ready;
+	bool stopping;
+};
+
+/* The dispatcher whose callback the thread is running, if any */
+static __thread package_manager_dispatcher_s *current_dispatcher;
+
+bool __dispatcher_is_current(package_manager_dispatcher_s *dispatcher)
+{
+	return dispatcher && current_dispatcher == dispatcher;
+}
+
+/* Whether the calling thread is a worker of a dispatcher being stopped */
+bool __dispatcher_current_stopping(void)
+{
+	package_manager_dispatcher_s *dispatcher = current_dispatcher;
+	bool stopping;
+
+	if (dispatcher == NULL)
+		return false;
+
+	pthread_mutex_lock(&dispatcher->lock);
+	stopping = dispatcher->stopping;
+	pthread_mutex_unlock(&dispatcher->lock);
+
+	return stopping;
+}
+
+static void __push_strand(dispatch_worker *worker, dispatch_strand *strand)
+{
+	package_manager_dispatcher_s *dispatcher = worker->dispatcher;
+
+	strand->next = NULL;
+
+	/* Queued before it is counted, so a reserved count always finds one */
+	pthread_mutex_lock(&worker->lock);
+	if (worker->tail)
+		worker->tail->next = strand;
+	else
+		worker->head = strand;
+	worker->tail = strand;
+	pthread_mutex_unlock(&worker->lock);
+
+	pthread_mutex_lock(&dispatcher->lock);
+	dispatcher->ready++;
+	pthread_cond_signal(&dispatcher->cond);
+	pthread_mutex_unlock(&dispatcher->lock);
+}
+
+static dispatch_strand *__pop_strand(dispatch_worker *worker)
+{
+	dispatch_strand *strand;
+
+	pthread_mutex_lock(&worker->lock);
+	strand = worker->head;
+	if (strand) {
+		worker->head = strand->next;
+		if (worker->head == NULL)
+			worker->tail = NULL;
+	}
+	pthread_mutex_unlock(&worker->lock);
+
+	return strand;
+}
+
+static dispatch_strand *__take_strand(dispatch_worker *worker)
+{
+	package_manager_dispatcher_s *dispatcher = worker->dispatcher;
+	dispatch_strand *strand;
+	int i;
+
+	/* A ready count has been reserved, so some queue holds a strand */
+	for (;;) {
+		for (i = 0; i < dispatcher->nr_workers; i++) {
+			strand = __pop_strand(&dispatcher->workers
+					      [(worker->index + i) %
+					       dispatcher->nr_workers]);
+			if (strand)
+				return strand;
+		}
+
+		/* Raced with the owner of the queue, let it get ahead */
+		sched_yield();
+	}
+}
+
+static void __run_strand(dispatch_worker *worker, dispatch_strand *strand)
+{
+	package_manager_dispatcher_s *dispatcher = worker->dispatcher;
+	dispatch_event *event;
+	int count;
+
+	for (count = 0; count < DISPATCH_BATCH; count++) {
+		pthread_mutex_lock(&dispatcher->lock);
+		event = strand->head;
+		if (event == NULL) {
+			g_hash_table_remove(dispatcher->strands, strand->pkg_name);
+			pthread_mutex_unlock(&dispatcher->lock);
+			return;
+		}
+		strand->head = event->next;
+		if (strand->head == NULL)
+			strand->tail = NULL;
+		pthread_mutex_unlock(&dispatcher->lock);
+
+		event->callback(event->pkg_type, event->pkg_name,
+				event->event_type, event->event_state,
+				event->progress, event->error,
+				event->user_data);
+		free(event);
+	}
+
+	/* Give the other packages a turn */
+	__push_strand(worker, strand);
+}
+
+static void *__worker_main(void *data)
+{
+	dispatch_worker *worker = data;
+	package_manager_dispatcher_s *dispatcher = worker->dispatcher;
+
+	current_dispatcher = dispatcher;
+
+	for (;;) {
+		pthread_mutex_lock(&dispatcher->lock);
+		while (dispatcher->ready == 0 && !dispatcher->stopping)
+			pthread_cond_wait(&dispatcher->cond, &dispatcher->lock);
+		if (dispatcher->ready == 0) {
+			pthread_mutex_unlock(&dispatcher->lock);
+			break;
+		}
+		dispatcher->ready--;
+		pthread_mutex_unlock(&dispatcher->lock);
+
+		__run_strand(worker, __take_strand(worker));
+	}
+
+	return NULL;
+}
+
+static void __free_strand(gpointer data)
+{
+	dispatch_strand *strand = data;
+	dispatch_event *event;
+
+	while (strand->head) {
+		event = strand->head;
+		strand->head = event->next;
+		free(event);
+	}
+	free(strand->pkg_name);
+	free(strand);
+}
+
+void __dispatcher_post(package_manager_dispatcher_s *dispatcher,
+		       package_manager_event_cb callback, void *user_data,
+		       const char *pkg_type, const char *pkg_name,
+		       package_manager_event_type_e event_type,
+		       package_manager_event_state_e event_state,
+		       int progress, package_manager_error_e error)
+{
+	dispatch_event *event;
+	dispatch_strand *strand;
+	size_t type_len;
+	size_t name_len;
+	bool schedule = false;
+
+	if (pkg_type == NULL)
+		pkg_type = "";
+	if (pkg_name == NULL)
+		pkg_name = "";
+
+	/* The strings are stored right after the event */
+	type_len = strlen(pkg_type) + 1;
+	name_len = strlen(pkg_name) + 1;
+	event = malloc(sizeof(dispatch_event) + type_len + name_len);
+	if (event == NULL) {
+		LOGE("malloc failed, dropping event of %s", pkg_name);
+		return;
+	}
+
+	event->callback = callback;
+	event->user_data = user_data;
+	event->pkg_type = (char *)(event + 1);
+	event->pkg_name = event->pkg_type + type_len;
+	memcpy(event->pkg_type, pkg_type, type_len);
+	memcpy(event->pkg_name, pkg_name, name_len);
+	event->event_type = event_type;
+	event->event_state = event_state;
+	event->progress = progress;
+	event->error = error;
+	event->next = NULL;
+
+	pthread_mutex_lock(&dispatcher->lock);
+
+	strand = g_hash_table_lookup(dispatcher->strands, pkg_name);
+	if (strand == NULL) {
+		strand = calloc(1, sizeof(dispatch_strand));
+		if (strand)
+			strand->pkg_name = strdup(pkg_name);
+		if (strand == NULL || strand->pkg_name == NULL) {
+			pthread_mutex_unlock(&dispatcher->lock);
+			LOGE("calloc failed, dropping event of %s", pkg_name);
+			free(strand);
+			free(event);
+			return;
+		}
+		g_hash_table_insert(dispatcher->strands, strand->pkg_name,
+				    strand);
+		schedule = true;
+	}
+
+	if (strand->tail)
+		strand->tail->next = event;
+	else
+		strand->head = event;
+	strand->tail = event;
+
+	pthread_mutex_unlock(&dispatcher->lock);
+
+	if (schedule)
+		__push_strand(&dispatcher->workers[g_str_hash(pkg_name) %
+						   dispatcher->nr_workers],
+			      strand);
+}
+
+void __dispatcher_destroy(package_manager_dispatcher_s *dispatcher)
+{
+	int i;
+
+	pthread_mutex_lock(&dispatcher->lock);
+	dispatcher->stopping = true;
+	pthread_cond_broadcast(&dispatcher->cond);
+	pthread_mutex_unlock(&dispatcher->lock);
+
+	/* Workers waiting for the main loop would never be joined */
+	__main_invoke_wakeup();
+
+	/* Workers leave once every queued strand has been run */
+	for (i = 0; i < dispatcher->nr_workers; i++) {
+		if (dispatcher->workers[i].running)
+			pthread_join(dispatcher->workers[i].thread, NULL);
+		pthread_mutex_destroy(&dispatcher->workers[i].lock);
+	}
+
+	g_hash_table_destroy(dispatcher->strands);
+	pthread_cond_destroy(&dispatcher->cond);
+	pthread_mutex_destroy(&dispatcher->lock);
+	free(dispatcher->workers);
+	free(dispatcher);
+}
+
+static int __dispatcher_create(int threads,
+			       package_manager_dispatcher_s **dispatcher)
+{
+	package_manager_dispatcher_s *d;
+	int i;
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads <= 0)
+		threads = 1;
+	if (threads > DISPATCH_MAX_THREADS)
+		threads = DISPATCH_MAX_THREADS;
+
+	d = calloc(1, sizeof(package_manager_dispatcher_s));
+	if (d == NULL)
+		return PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY;
+
+	d->workers = calloc(threads, sizeof(dispatch_worker));
+	if (d->workers == NULL) {
+		free(d);
+		return PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY;
+	}
+
+	d->nr_workers = threads;
+	d->strands = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+					   __free_strand);
+	pthread_mutex_init(&d->lock, NULL);
+	pthread_cond_init(&d->cond, NULL);
+
+	for (i = 0; i < threads; i++) {
+		d->workers[i].dispatcher = d;
+		d->workers[i].index = i;
+		pthread_mutex_init(&d->workers[i].lock, NULL);
+	}
+
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&d->workers[i].thread, NULL, __worker_main,
+				   &d->workers[i]) != 0) {
+			__dispatcher_destroy(d);
+			return PACKAGE_MANAGER_ERROR_IO_ERROR;
+		}
+		d->workers[i].running = true;
+	}
+
+	*dispatcher = d;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_set_dispatch_mode(package_manager_h manager,
+				      package_manager_dispatch_mode_e mode,
+				      int threads)
+{
+	package_manager_dispatcher_s *dispatcher;
+	int ret;
+
+	if (package_manager_valiate_handle(manager)) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	/* A worker cannot wait for itself to stop */
+	if (__dispatcher_is_current(manager->dispatcher)) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     "called from a parallel event callback");
+	}
+
+	switch (mode) {
+	case PACKAGE_MANAGER_DISPATCH_MODE_SERIAL:
+		if (manager->dispatcher) {
+			dispatcher = manager->dispatcher;
+			manager->dispatcher = NULL;
+			__dispatcher_destroy(dispatcher);
+		}
+		break;
+
+	case PACKAGE_MANAGER_DISPATCH_MODE_PARALLEL:
+		ret = __dispatcher_create(threads, &dispatcher);
+		if (ret != PACKAGE_MANAGER_ERROR_NONE) {
+			return package_manager_error(ret, __FUNCTION__,
+						     "failed to start the dispatch threads");
+		}
+
+		if (manager->dispatcher)
+			__dispatcher_destroy(manager->dispatcher);
+		manager->dispatcher = dispatcher;
+		break;
+
+	default:
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <glib.h>
+#include <dlog.h>
+
+#include <package_manager_private.h>
+
+/*
+ * A waiter is shared by all the futures of one wait call and lives on the
+ * waiting thread's stack. Completions only decrement its counter, and the
+ * last one signals it, so waiting for N futures costs one wakeup.
+ */
+typedef struct _future_waiter {
+	pthread_cond_t cond;
+	int remaining;
+} future_waiter;
+
+/*
+ * A future is referenced by its owner, by the event_info entry tracking
+ * the request until it finishes, and by the idle source running its
+ * completion callback. The callback runs from the main loop rather than
+ * from the package manager event handler, so that it may destroy the
+ * request handle or resume a coroutine doing so.
+ */
+struct package_manager_future_s {
+	int refcount;
+	int id;
+	bool ready;
+	package_manager_event_state_e event_state;
+	package_manager_error_e error;
+	package_manager_future_completed_cb completed_cb;
+	void *user_data;
+	bool calling;		/* completed_cb is running on caller */
+	pthread_t caller;
+	future_waiter *waiter;
+};
+
+static pthread_mutex_t future_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t future_called = PTHREAD_COND_INITIALIZER;
+
+static void __future_unref(package_manager_future_h future)
+{
+	if (__sync_sub_and_fetch(&future->refcount, 1) == 0)
+		free(future);
+}
+
+static gboolean __future_notify(gpointer data)
+{
+	package_manager_future_h future = data;
+	package_manager_future_completed_cb callback;
+	void *user_data;
+
+	pthread_mutex_lock(&future_lock);
+	callback = future->completed_cb;
+	user_data = future->user_data;
+	future->completed_cb = NULL;
+	future->user_data = NULL;
+	if (callback) {
+		future->calling = true;
+		future->caller = pthread_self();
+	}
+	pthread_mutex_unlock(&future_lock);
+
+	if (callback) {
+		callback(future, user_data);
+
+		pthread_mutex_lock(&future_lock);
+		future->calling = false;
+		pthread_cond_broadcast(&future_called);
+		pthread_mutex_unlock(&future_lock);
+	}
+
+	__future_unref(future);
+
+	return FALSE;
+}
+
+void __future_complete(package_manager_future_h future,
+		       package_manager_event_state_e event_state,
+		       package_manager_error_e error)
+{
+	bool notify;
+
+	pthread_mutex_lock(&future_lock);
+
+	if (future->ready) {
+		pthread_mutex_unlock(&future_lock);
+		return;
+	}
+
+	future->ready = true;
+	future->event_state = event_state;
+	future->error = error;
+
+	if (future->waiter && --future->waiter->remaining == 0)
+		pthread_cond_signal(&future->waiter->cond);
+	future->waiter = NULL;
+
+	notify = future->completed_cb != NULL;
+
+	pthread_mutex_unlock(&future_lock);
+
+	/* The reference of the event_info entry goes to the idle source */
+	if (notify)
+		g_idle_add(__future_notify, future);
+	else
+		__future_unref(future);
+}
+
+typedef struct _async_call {
+	package_manager_request_h request;
+	package_manager_event_type_e event_type;
+	const char *target;
+	package_manager_future_h future;
+} async_call;
+
+/* An installation submitted once its file was staged */
+static void __async_submitted(void *owner, int ret, int id, event_info *info)
+{
+	package_manager_future_h future = owner;
+
+	future->id = id;
+
+	/* The reference of the deferred installation goes to info */
+	if (info)
+		info->future = future;
+	else
+		__future_complete(future, PACAKGE_MANAGER_EVENT_STATE_FAILED,
+				  ret);
+}
+
+/* Runs on the thread dispatching the events, see __main_invoke() */
+static int __async_submit(void *data)
+{
+	async_call *call = data;
+	event_info *info;
+	int ret;
+
+	if (call->event_type == PACAKGE_MANAGER_EVENT_TYPE_INSTALL)
+		ret = __request_submit_staged(call->request, call->target,
+					      &call->future->id, &info,
+					      __async_submitted, call->future);
+	else
+		ret = __request_submit(call->request, call->event_type,
+				       call->target, &call->future->id, &info);
+	if (ret != PACKAGE_MANAGER_ERROR_NONE)
+		return ret;
+
+	call->future->refcount = 2;
+	if (info)
+		info->future = call->future;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+static int __request_async(package_manager_request_h request,
+			   package_manager_event_type_e event_type,
+			   const char *target,
+			   package_manager_future_h *future,
+			   const char *function)
+{
+	async_call call = {
+		.request = request,
+		.event_type = event_type,
+		.target = target,
+	};
+	int ret;
+
+	if (package_manager_client_valiate_handle(request) || target == NULL
+	    || future == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, function, NULL);
+	}
+
+	call.future = calloc(1, sizeof(struct package_manager_future_s));
+	if (call.future == NULL) {
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY,
+					  function,
+					  "failed to create a future handle");
+	}
+	call.future->id = -1;
+
+	ret = __main_invoke(__async_submit, &call);
+	if (ret != PACKAGE_MANAGER_ERROR_NONE) {
+		free(call.future);
+		return package_manager_error(ret, function, NULL);
+	}
+
+	*future = call.future;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_request_install_async(package_manager_request_h request,
+					  const char *path,
+					  package_manager_future_h *future)
+{
+	return __request_async(request, PACAKGE_MANAGER_EVENT_TYPE_INSTALL,
+			       path, future, __FUNCTION__);
+}
+
+int package_manager_request_uninstall_async(package_manager_request_h request,
+					    const char *name,
+					    package_manager_future_h *future)
+{
+	return __request_async(request, PACAKGE_MANAGER_EVENT_TYPE_UNINSTALL,
+			       name, future, __FUNCTION__);
+}
+
+int package_manager_future_get_id(package_manager_future_h future, int *id)
+{
+	if (future == NULL || id == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	*id = future->id;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_future_get_result(package_manager_future_h future,
+				      bool *ready,
+				      package_manager_event_state_e *event_state,
+				      package_manager_error_e *error)
+{
+	if (future == NULL || ready == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	pthread_mutex_lock(&future_lock);
+	*ready = future->ready;
+	if (event_state)
+		*event_state = future->event_state;
+	if (error)
+		*error = future->error;
+	pthread_mutex_unlock(&future_lock);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_future_set_completed_cb(package_manager_future_h future,
+					    package_manager_future_completed_cb callback,
+					    void *user_data)
+{
+	bool ready;
+
+	if (future == NULL || callback == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	pthread_mutex_lock(&future_lock);
+	ready = future->ready;
+	future->completed_cb = callback;
+	future->user_data = user_data;
+	if (ready)
+		__sync_add_and_fetch(&future->refcount, 1);
+	pthread_mutex_unlock(&future_lock);
+
+	if (ready)
+		g_idle_add(__future_notify, future);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_future_wait_all(package_manager_future_h *futures,
+				    int count, int timeout)
+{
+	future_waiter waiter;
+	pthread_condattr_t attr;
+	struct timespec deadline;
+	int ret = 0;
+	int i;
+
+	if (futures == NULL || count < 0) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (futures[i] == NULL) {
+			return
+			    package_manager_error
+			    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER,
+			     __FUNCTION__, NULL);
+		}
+	}
+
+	if (timeout >= 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (timeout % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&waiter.cond, &attr);
+	pthread_condattr_destroy(&attr);
+	waiter.remaining = 0;
+
+	pthread_mutex_lock(&future_lock);
+
+	for (i = 0; i < count; i++) {
+		if (futures[i]->ready)
+			continue;
+		if (futures[i]->waiter) {
+			ret = EBUSY;
+			break;
+		}
+		futures[i]->waiter = &waiter;
+		waiter.remaining++;
+	}
+
+	while (ret == 0 && waiter.remaining > 0) {
+		if (timeout >= 0)
+			ret = pthread_cond_timedwait(&waiter.cond, &future_lock,
+						     &deadline);
+		else
+			ret = pthread_cond_wait(&waiter.cond, &future_lock);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (futures[i]->waiter == &waiter)
+			futures[i]->waiter = NULL;
+	}
+
+	pthread_mutex_unlock(&future_lock);
+	pthread_cond_destroy(&waiter.cond);
+
+	if (ret == EBUSY) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     "a future is already being waited for");
+	}
+
+	if (waiter.remaining > 0) {
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_TIMED_OUT,
+					  __FUNCTION__, NULL);
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_future_wait(package_manager_future_h future, int timeout)
+{
+	return package_manager_future_wait_all(&future, 1, timeout);
+}
+
+int package_manager_future_destroy(package_manager_future_h future)
+{
+	if (future == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	pthread_mutex_lock(&future_lock);
+	future->completed_cb = NULL;
+	future->user_data = NULL;
+
+	/* Once this returns, the callback no longer uses its user data */
+	while (future->calling && !pthread_equal(future->caller, pthread_self()))
+		pthread_cond_wait(&future_called, &future_lock);
+	pthread_mutex_unlock(&future_lock);
+
+	__future_unref(future);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <dlog.h>
+
+#include <package_manager_private.h>
+
+#define JOURNAL_SIZE 256	/* must be a power of two */
+#define JOURNAL_MASK (JOURNAL_SIZE - 1)
+#define JOURNAL_TYPE_LEN 32
+#define JOURNAL_NAME_LEN 128
+
+/*
+ * The journal is written only from the main loop by the first listening
+ * handle, and may be read from any thread. Each entry is guarded by its
+ * own sequence number, which is cleared while the entry is rewritten, so
+ * readers never take a lock and simply skip entries that were recycled
+ * under them.
+ *
+ * Completed events also bump the package-set generation, which lets
+ * mirrors of the installed packages resync incrementally.
+ */
+typedef struct _journal_entry {
+	volatile unsigned int seq;
+	char type[JOURNAL_TYPE_LEN];
+	char package[JOURNAL_NAME_LEN];
+	package_manager_event_type_e event_type;
+	package_manager_event_state_e event_state;
+	package_manager_error_e error;
+	unsigned int generation;	/* 0 unless the event completed */
+} journal_entry;
+
+typedef struct _journal_change {
+	char *type;
+	package_manager_event_type_e first;
+	package_manager_event_type_e last;
+} journal_change;
+
+static journal_entry journal[JOURNAL_SIZE];
+static volatile unsigned int journal_seq;
+static volatile unsigned int journal_generation;
+
+void __journal_record(const char *pkg_type, const char *pkg_name,
+		      package_manager_event_type_e event_type,
+		      package_manager_event_state_e event_state,
+		      package_manager_error_e error)
+{
+	journal_entry *entry;
+	unsigned int seq;
+
+	seq = journal_seq + 1;
+	entry = &journal[seq & JOURNAL_MASK];
+
+	entry->seq = 0;
+	__sync_synchronize();
+
+	snprintf(entry->type, sizeof(entry->type), "%s",
+		 pkg_type ? pkg_type : "");
+	snprintf(entry->package, sizeof(entry->package), "%s",
+		 pkg_name ? pkg_name : "");
+	entry->event_type = event_type;
+	entry->event_state = event_state;
+	entry->error = error;
+	if (event_state == PACAKGE_MANAGER_EVENT_STATE_COMPLETED)
+		entry->generation = journal_generation + 1;
+	else
+		entry->generation = 0;
+
+	__sync_synchronize();
+	entry->seq = seq;
+	__sync_synchronize();
+	journal_seq = seq;
+	__sync_synchronize();
+	if (entry->generation)
+		journal_generation = entry->generation;
+}
+
+static bool __journal_copy(unsigned int seq, journal_entry *copy)
+{
+	journal_entry *entry = &journal[seq & JOURNAL_MASK];
+
+	if (entry->seq != seq)
+		return false;
+	__sync_synchronize();
+	memcpy(copy, entry, sizeof(*copy));
+	__sync_synchronize();
+	if (entry->seq != seq)
+		return false;
+
+	copy->type[JOURNAL_TYPE_LEN - 1] = '\0';
+	copy->package[JOURNAL_NAME_LEN - 1] = '\0';
+
+	return true;
+}
+
+static unsigned int __journal_first(unsigned int seq, unsigned int last)
+{
+	if (last >= JOURNAL_SIZE && seq < last - JOURNAL_SIZE)
+		return last - JOURNAL_SIZE + 1;
+
+	return seq + 1;
+}
+
+int package_manager_get_events_since(unsigned int seq,
+				     package_manager_journal_event_cb callback,
+				     void *user_data)
+{
+	journal_entry copy;
+	unsigned int last;
+	unsigned int cur;
+
+	if (callback == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	last = journal_seq;
+	__sync_synchronize();
+
+	for (cur = __journal_first(seq, last); cur <= last; cur++) {
+		if (!__journal_copy(cur, &copy))
+			continue;
+
+		if (!callback(cur, copy.type, copy.package, copy.event_type,
+			      copy.event_state, copy.error, user_data))
+			break;
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_get_event_seq(unsigned int *seq)
+{
+	if (seq == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	*seq = journal_seq;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+static void __free_change(gpointer data)
+{
+	journal_change *change = data;
+
+	free(change->type);
+	free(change);
+}
+
+int package_manager_get_generation(unsigned int *generation)
+{
+	if (generation == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	*generation = journal_generation;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_get_changes(unsigned int since_generation,
+				package_manager_change_cb callback,
+				void *user_data, unsigned int *generation,
+				bool *resync)
+{
+	GHashTable *changes;
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	journal_change *change;
+	journal_entry copy;
+	package_manager_change_e kind;
+	unsigned int last;
+	unsigned int current;
+	unsigned int found = 0;
+	unsigned int cur;
+
+	if (callback == NULL || generation == NULL || resync == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	/* The writer publishes the sequence before the generation */
+	current = journal_generation;
+	__sync_synchronize();
+	last = journal_seq;
+	__sync_synchronize();
+
+	*generation = current;
+	*resync = false;
+
+	if (since_generation == current)
+		return PACKAGE_MANAGER_ERROR_NONE;
+
+	/* Kept from an earlier process, where the counter went further */
+	if (since_generation > current) {
+		*resync = true;
+		return PACKAGE_MANAGER_ERROR_NONE;
+	}
+
+	changes = g_hash_table_new_full(g_str_hash, g_str_equal, free,
+					__free_change);
+	if (changes == NULL) {
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY,
+					  __FUNCTION__, NULL);
+	}
+
+	for (cur = __journal_first(0, last); cur <= last; cur++) {
+		if (!__journal_copy(cur, &copy))
+			continue;
+		if (copy.generation <= since_generation
+		    || copy.generation > current)
+			continue;
+
+		found++;
+
+		change = g_hash_table_lookup(changes, copy.package);
+		if (change == NULL) {
+			change = calloc(1, sizeof(journal_change));
+			if (change == NULL)
+				break;
+			change->first = copy.event_type;
+			g_hash_table_insert(changes, strdup(copy.package),
+					    change);
+		}
+
+		free(change->type);
+		change->type = strdup(copy.type);
+		change->last = copy.event_type;
+	}
+
+	/* Some of the requested history has already been recycled */
+	if (found != current - since_generation) {
+		g_hash_table_destroy(changes);
+		*resync = true;
+		return PACKAGE_MANAGER_ERROR_NONE;
+	}
+
+	g_hash_table_iter_init(&iter, changes);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		change = value;
+
+		if (change->last == PACAKGE_MANAGER_EVENT_TYPE_UNINSTALL)
+			kind = PACKAGE_MANAGER_CHANGE_REMOVED;
+		else if (change->first == PACAKGE_MANAGER_EVENT_TYPE_INSTALL)
+			kind = PACKAGE_MANAGER_CHANGE_ADDED;
+		else
+			kind = PACKAGE_MANAGER_CHANGE_UPDATED;
+
+		if (!callback(change->type, key, kind, user_data))
+			break;
+	}
+
+	g_hash_table_destroy(changes);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
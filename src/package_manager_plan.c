@@ -0,0 +1,569 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <dlog.h>
+
+#include <package_manager_private.h>
+
+/*
+ * Packages form a DAG through the names they require. A package waits
+ * until each of its prerequisites in the plan has completed, then goes to
+ * the ready queue, from which up to max_parallel installations are kept
+ * running. A failed package cancels everything that depends on it.
+ *
+ * With a staging directory, every package is queued for copying when the
+ * plan starts. Ready packages whose copy is not done yet are skipped, and
+ * the plan is resumed once it is, see __request_staged().
+ */
+struct _plan_node {
+	package_manager_plan_h plan;
+	char *path;
+	char *package;
+	GSList *requires;	/* names of the required packages */
+	GSList *dependents;	/* nodes requiring this one */
+	int pending;		/* prerequisites not completed yet */
+	int req_id;
+	bool running;
+	bool finished;
+	package_manager_event_state_e event_state;
+	package_manager_error_e error;
+	struct _plan_node *next;
+	struct _plan_node *ready_next;
+};
+
+struct package_manager_plan_s {
+	package_manager_request_h request;
+	GHashTable *nodes;	/* package -> plan_node */
+	plan_node *head;
+	plan_node *tail;
+	plan_node *ready_head;
+	plan_node *ready_tail;
+	int count;
+	int running;
+	int finished;
+	int failed;
+	int max_parallel;
+	bool executing;
+	package_manager_plan_event_cb event_cb;
+	void *user_data;
+	int dispatching;	/* calls which may invoke the callback */
+	bool destroyed;		/* destroyed from the callback */
+};
+
+static int package_manager_plan_validate_handle(package_manager_plan_h plan)
+{
+	if (plan == NULL || plan->request == NULL) {
+		return PACKAGE_MANAGER_ERROR_INVALID_PARAMETER;
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+package_manager_plan_h __plan_node_owner(plan_node *node)
+{
+	return node->plan;
+}
+
+/* Called when the request is destroyed before the plan */
+void __plan_detach(package_manager_plan_h plan)
+{
+	plan->request = NULL;
+}
+
+static void __plan_free(package_manager_plan_h plan)
+{
+	plan_node *node;
+
+	while (plan->head) {
+		node = plan->head;
+		plan->head = node->next;
+		g_slist_free_full(node->requires, free);
+		g_slist_free(node->dependents);
+		free(node->path);
+		free(node->package);
+		free(node);
+	}
+
+	g_hash_table_destroy(plan->nodes);
+	free(plan);
+}
+
+/* The callback may destroy the plan, keep it until we are done */
+static void __plan_enter(package_manager_plan_h plan)
+{
+	plan->dispatching++;
+}
+
+static void __plan_leave(package_manager_plan_h plan)
+{
+	if (--plan->dispatching == 0 && plan->destroyed)
+		__plan_free(plan);
+}
+
+static void __plan_notify(package_manager_plan_h plan, const char *package,
+			  package_manager_event_state_e event_state,
+			  package_manager_error_e error)
+{
+	if (plan->event_cb)
+		plan->event_cb(plan, package, event_state, error,
+			       plan->user_data);
+}
+
+static void __plan_enqueue(plan_node *node)
+{
+	package_manager_plan_h plan = node->plan;
+
+	node->ready_next = NULL;
+	if (plan->ready_tail)
+		plan->ready_tail->ready_next = node;
+	else
+		plan->ready_head = node;
+	plan->ready_tail = node;
+}
+
+static void __plan_finish(plan_node *node,
+			  package_manager_event_state_e event_state,
+			  package_manager_error_e error)
+{
+	package_manager_plan_h plan = node->plan;
+	plan_node *dependent;
+	GSList *l;
+
+	node->finished = true;
+	node->event_state = event_state;
+	node->error = error;
+
+	/* Drops the copy of a canceled package, the others have taken theirs */
+	if (plan->request && plan->request->staging)
+		__staging_discard(plan->request->staging, node->path);
+
+	plan->finished++;
+	if (event_state == PACAKGE_MANAGER_EVENT_STATE_FAILED)
+		plan->failed++;
+
+	__plan_notify(plan, node->package, event_state, error);
+
+	for (l = node->dependents; l; l = l->next) {
+		dependent = l->data;
+		if (dependent->finished)
+			continue;
+
+		if (event_state == PACAKGE_MANAGER_EVENT_STATE_FAILED)
+			__plan_finish(dependent,
+				      PACAKGE_MANAGER_EVENT_STATE_FAILED,
+				      PACKAGE_MANAGER_ERROR_CANCELED);
+		else if (--dependent->pending == 0)
+			__plan_enqueue(dependent);
+	}
+}
+
+/* Submits ready packages while there is room */
+static void __plan_pump(package_manager_plan_h plan)
+{
+	plan_node *prev = NULL;
+	plan_node *node = plan->ready_head;
+	event_info *info;
+	int ret;
+
+	/* The request may be destroyed from the plan callback */
+	while (plan->request && node
+	       && (plan->max_parallel == 0
+		   || plan->running < plan->max_parallel)) {
+		/* Its copy must not be waited for on the main loop */
+		if (plan->request->staging
+		    && !__staging_ready(plan->request->staging, node->path)) {
+			prev = node;
+			node = node->ready_next;
+			continue;
+		}
+
+		if (prev)
+			prev->ready_next = node->ready_next;
+		else
+			plan->ready_head = node->ready_next;
+		if (plan->ready_tail == node)
+			plan->ready_tail = prev;
+
+		ret = __request_submit(plan->request,
+				       PACAKGE_MANAGER_EVENT_TYPE_INSTALL,
+				       node->path, &node->req_id, &info);
+		if (ret != PACKAGE_MANAGER_ERROR_NONE) {
+			LOGE("failed to submit %s (%d)", node->path, ret);
+			__plan_finish(node, PACAKGE_MANAGER_EVENT_STATE_FAILED,
+				      ret);
+		} else {
+			info->node = node;
+			node->running = true;
+			plan->running++;
+
+			__plan_notify(plan, node->package,
+				      PACAKGE_MANAGER_EVENT_STATE_STARTED,
+				      PACKAGE_MANAGER_ERROR_NONE);
+		}
+
+		/* Dependents may have been queued behind it meanwhile */
+		node = prev ? prev->ready_next : plan->ready_head;
+	}
+
+	if (plan->running == 0 && plan->finished == plan->count)
+		__plan_notify(plan, NULL,
+			      plan->failed ?
+			      PACAKGE_MANAGER_EVENT_STATE_FAILED :
+			      PACAKGE_MANAGER_EVENT_STATE_COMPLETED,
+			      PACKAGE_MANAGER_ERROR_NONE);
+}
+
+void __plan_node_event(plan_node *node,
+		       package_manager_event_state_e event_state,
+		       package_manager_error_e error)
+{
+	package_manager_plan_h plan = node->plan;
+
+	if (!node->running)
+		return;
+
+	node->running = false;
+	plan->running--;
+
+	__plan_enter(plan);
+	__plan_finish(node, event_state, error);
+	__plan_pump(plan);
+	__plan_leave(plan);
+}
+
+int package_manager_plan_create(package_manager_request_h request,
+				package_manager_plan_h *plan)
+{
+	struct package_manager_plan_s *package_manager_plan;
+
+	if (package_manager_client_valiate_handle(request) || plan == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	package_manager_plan = calloc(1, sizeof(struct package_manager_plan_s));
+	if (package_manager_plan == NULL) {
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY,
+					  __FUNCTION__,
+					  "failed to create a plan handle");
+	}
+
+	package_manager_plan->nodes = g_hash_table_new(g_str_hash, g_str_equal);
+	package_manager_plan->request = request;
+	request->plans = g_slist_prepend(request->plans, package_manager_plan);
+
+	*plan = package_manager_plan;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+static bool __plan_add_requirement(const char *package, void *user_data)
+{
+	plan_node *node = user_data;
+	char *required;
+
+	required = strdup(package);
+	if (required)
+		node->requires = g_slist_prepend(node->requires, required);
+
+	return true;
+}
+
+int package_manager_plan_add_package(package_manager_plan_h plan,
+				     const char *path)
+{
+	package_manager_archive_info_h info;
+	plan_node *node;
+	char *package;
+	int ret;
+
+	if (package_manager_plan_validate_handle(plan) || plan->executing
+	    || path == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	ret = package_manager_get_archive_info(path, &info);
+	if (ret != PACKAGE_MANAGER_ERROR_NONE)
+		return package_manager_error(ret, __FUNCTION__, path);
+
+	ret = package_manager_archive_info_get_package(info, &package);
+	if (ret != PACKAGE_MANAGER_ERROR_NONE) {
+		package_manager_archive_info_destroy(info);
+		return package_manager_error(ret, __FUNCTION__, NULL);
+	}
+
+	if (g_hash_table_lookup(plan->nodes, package)) {
+		free(package);
+		package_manager_archive_info_destroy(info);
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     "the package is already part of the plan");
+	}
+
+	node = calloc(1, sizeof(plan_node));
+	if (node)
+		node->path = strdup(path);
+	if (node == NULL || node->path == NULL) {
+		free(node);
+		free(package);
+		package_manager_archive_info_destroy(info);
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY,
+					  __FUNCTION__, NULL);
+	}
+
+	node->plan = plan;
+	node->package = package;
+	node->req_id = -1;
+	package_manager_archive_info_foreach_dependency(info,
+							__plan_add_requirement,
+							node);
+	package_manager_archive_info_destroy(info);
+
+	g_hash_table_insert(plan->nodes, node->package, node);
+	if (plan->tail)
+		plan->tail->next = node;
+	else
+		plan->head = node;
+	plan->tail = node;
+	plan->count++;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_plan_add_dependency(package_manager_plan_h plan,
+					const char *package,
+					const char *required)
+{
+	plan_node *node;
+	char *name;
+
+	if (package_manager_plan_validate_handle(plan) || plan->executing
+	    || package == NULL || required == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	node = g_hash_table_lookup(plan->nodes, package);
+	if (node == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     "the package is not part of the plan");
+	}
+
+	name = strdup(required);
+	if (name == NULL) {
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY,
+					  __FUNCTION__, NULL);
+	}
+
+	node->requires = g_slist_prepend(node->requires, name);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+static void __plan_unlink(package_manager_plan_h plan)
+{
+	plan_node *node;
+
+	for (node = plan->head; node; node = node->next) {
+		g_slist_free(node->dependents);
+		node->dependents = NULL;
+		node->pending = 0;
+	}
+}
+
+/* Builds the edges of the DAG, and fails if they form a cycle */
+static bool __plan_link(package_manager_plan_h plan)
+{
+	plan_node *node;
+	plan_node *required;
+	plan_node *head = NULL;
+	plan_node *tail = NULL;
+	GSList *l;
+	int sorted = 0;
+
+	for (node = plan->head; node; node = node->next) {
+		for (l = node->requires; l; l = l->next) {
+			required = g_hash_table_lookup(plan->nodes, l->data);
+			if (required == NULL || required == node)
+				continue;
+			required->dependents =
+			    g_slist_prepend(required->dependents, node);
+			node->pending++;
+		}
+	}
+
+	/* Kahn's algorithm, on a copy of the counts kept in req_id */
+	for (node = plan->head; node; node = node->next) {
+		node->req_id = node->pending;
+		node->ready_next = NULL;
+		if (node->pending)
+			continue;
+		if (tail)
+			tail->ready_next = node;
+		else
+			head = node;
+		tail = node;
+	}
+
+	for (node = head; node; node = node->ready_next) {
+		sorted++;
+		for (l = node->dependents; l; l = l->next) {
+			required = l->data;
+			if (--required->req_id == 0) {
+				tail->ready_next = required;
+				tail = required;
+			}
+		}
+	}
+
+	for (node = plan->head; node; node = node->next) {
+		node->req_id = -1;
+		node->ready_next = NULL;
+	}
+
+	if (sorted != plan->count) {
+		__plan_unlink(plan);
+		return false;
+	}
+
+	return true;
+}
+
+/* Called on the main loop once a staged copy is done */
+void __plan_resume(package_manager_plan_h plan)
+{
+	/* Nothing is left to submit once the plan has finished */
+	if (plan->executing && plan->ready_head) {
+		__plan_enter(plan);
+		__plan_pump(plan);
+		__plan_leave(plan);
+	}
+}
+
+/* Runs on the thread dispatching the events, see __main_invoke() */
+static int __plan_start(void *data)
+{
+	package_manager_plan_h plan = data;
+	plan_node *node;
+
+	/* Copy everything ahead, the packages which can start first first */
+	if (plan->request && plan->request->staging) {
+		for (node = plan->head; node; node = node->next)
+			if (node->pending == 0)
+				__staging_queue(plan->request->staging,
+						node->path);
+		for (node = plan->head; node; node = node->next)
+			if (node->pending)
+				__staging_queue(plan->request->staging,
+						node->path);
+	}
+
+	for (node = plan->head; node; node = node->next) {
+		if (node->pending == 0)
+			__plan_enqueue(node);
+	}
+
+	__plan_enter(plan);
+	__plan_pump(plan);
+	__plan_leave(plan);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_plan_execute(package_manager_plan_h plan, int max_parallel,
+				 package_manager_plan_event_cb callback,
+				 void *user_data)
+{
+	int ret;
+
+	if (package_manager_plan_validate_handle(plan) || plan->executing
+	    || plan->count == 0 || max_parallel < 0) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	if (!__plan_link(plan)) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     "the dependencies form a cycle");
+	}
+
+	plan->executing = true;
+	plan->max_parallel = max_parallel;
+	plan->event_cb = callback;
+	plan->user_data = user_data;
+
+	ret = __main_invoke(__plan_start, plan);
+	if (ret != PACKAGE_MANAGER_ERROR_NONE) {
+		__plan_unlink(plan);
+		plan->executing = false;
+		plan->event_cb = NULL;
+		plan->user_data = NULL;
+		return package_manager_error(ret, __FUNCTION__,
+					     "failed to start the plan");
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_plan_destroy(package_manager_plan_h plan)
+{
+	if (plan == NULL || plan->destroyed) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	if (plan->request) {
+		if (plan->executing)
+			__request_detach_plan(plan->request, plan);
+		plan->request->plans = g_slist_remove(plan->request->plans,
+						      plan);
+	}
+
+	plan->request = NULL;
+
+	/* Freed once the callback returns, nothing is reported meanwhile */
+	if (plan->dispatching > 0) {
+		plan->event_cb = NULL;
+		plan->destroyed = true;
+		return PACKAGE_MANAGER_ERROR_NONE;
+	}
+
+	__plan_free(plan);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
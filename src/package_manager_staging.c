@@ -0,0 +1,565 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include <glib.h>
+#include <dlog.h>
+
+#include <package_manager_private.h>
+
+/*
+ * Package files are copied into the staging directory by a thread of
+ * their own, so that the package manager reads them from local storage.
+ * Files queued ahead are copied while the previous ones are installed.
+ *
+ * The main loop never waits for a copy. Plans, transactions and futures
+ * submit an installation once its copy is done, resumed from an idle
+ * callback posted by the copying thread. Direct installations wait for
+ * the copy in the calling thread, unless it runs the main loop: the file
+ * is then installed from where it is if it has not been copied yet.
+ */
+typedef enum {
+	STAGING_QUEUED,
+	STAGING_COPYING,
+	STAGING_DONE,
+} staging_state_e;
+
+typedef struct _staging_entry {
+	char *path;
+	char *staged;
+	staging_state_e state;
+	bool discarded;		/* dropped once its copy is done */
+	package_manager_error_e error;
+	struct _staging_entry *next;
+} staging_entry;
+
+struct package_manager_staging_s {
+	char *dir;
+	pthread_mutex_t lock;
+	pthread_cond_t queued;
+	pthread_cond_t copied;
+	pthread_t thread;
+	bool running;
+	bool stopping;
+	void (*ready_cb) (void *data);	/* on the main loop, once a copy is done */
+	void *ready_data;
+	guint idle;
+	GHashTable *entries;	/* path -> staging_entry, until taken */
+	staging_entry *head;
+	staging_entry *tail;
+};
+
+/* Copies in the kernel, sharing the extents where the filesystem can */
+static int __stage_copy(int in, int out, off_t size)
+{
+	off_t done = 0;
+	ssize_t n;
+
+#ifdef FICLONE
+	if (ioctl(out, FICLONE, in) == 0)
+		return 0;
+#endif
+
+	while (done < size) {
+		n = copy_file_range(in, NULL, out, NULL, size - done, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += n;
+	}
+
+	/* Across filesystems on older kernels */
+	while (done < size) {
+		n = sendfile(out, in, NULL, size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		done += n;
+	}
+
+	return 0;
+}
+
+static package_manager_error_e __stage_file(const char *dir, const char *path,
+					    char **staged)
+{
+	struct stat st;
+	const char *name;
+	char *template;
+	int in;
+	int out;
+	int ret;
+
+	in = open(path, O_RDONLY | O_CLOEXEC);
+	if (in < 0) {
+		LOGE("failed to open %s (%d)", path, errno);
+		return errno == ENOENT ? PACKAGE_MANAGER_ERROR_INVALID_PARAMETER
+		    : PACKAGE_MANAGER_ERROR_IO_ERROR;
+	}
+
+	if (fstat(in, &st) < 0 || !S_ISREG(st.st_mode)) {
+		close(in);
+		return PACKAGE_MANAGER_ERROR_INVALID_PARAMETER;
+	}
+
+	/* Keep the file name, installers look at its extension */
+	name = strrchr(path, '/');
+	name = name ? name + 1 : path;
+	if (asprintf(&template, "%s/XXXXXX-%s", dir, name) < 0) {
+		close(in);
+		return PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY;
+	}
+
+	out = mkstemps(template, strlen(name) + 1);
+	if (out < 0) {
+		LOGE("failed to create a file in %s (%d)", dir, errno);
+		free(template);
+		close(in);
+		return PACKAGE_MANAGER_ERROR_IO_ERROR;
+	}
+
+	posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+	fchmod(out, st.st_mode & 0644);
+
+	ret = __stage_copy(in, out, st.st_size);
+	if (ret == 0)
+		ret = close(out);
+	else
+		close(out);
+
+	/* The original is not read again */
+	posix_fadvise(in, 0, 0, POSIX_FADV_DONTNEED);
+	close(in);
+
+	if (ret < 0) {
+		LOGE("failed to stage %s (%d)", path, errno);
+		unlink(template);
+		free(template);
+		return PACKAGE_MANAGER_ERROR_IO_ERROR;
+	}
+
+	*staged = template;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+static gboolean __staging_notify(gpointer data)
+{
+	package_manager_staging_s *staging = data;
+
+	pthread_mutex_lock(&staging->lock);
+	staging->idle = 0;
+	pthread_mutex_unlock(&staging->lock);
+
+	/* May destroy the staging */
+	staging->ready_cb(staging->ready_data);
+
+	return FALSE;
+}
+
+static void *__staging_main(void *data)
+{
+	package_manager_staging_s *staging = data;
+	staging_entry *entry;
+	package_manager_error_e error;
+	char *staged = NULL;
+
+	pthread_mutex_lock(&staging->lock);
+
+	for (;;) {
+		while (staging->head == NULL && !staging->stopping)
+			pthread_cond_wait(&staging->queued, &staging->lock);
+		if (staging->stopping)
+			break;
+
+		entry = staging->head;
+		staging->head = entry->next;
+		if (staging->head == NULL)
+			staging->tail = NULL;
+		entry->state = STAGING_COPYING;
+
+		pthread_mutex_unlock(&staging->lock);
+		error = __stage_file(staging->dir, entry->path, &staged);
+		pthread_mutex_lock(&staging->lock);
+
+		entry->staged = error == PACKAGE_MANAGER_ERROR_NONE ? staged : NULL;
+		entry->error = error;
+		entry->state = STAGING_DONE;
+		if (entry->discarded)
+			g_hash_table_remove(staging->entries, entry->path);
+		pthread_cond_broadcast(&staging->copied);
+
+		if (staging->ready_cb && staging->idle == 0)
+			staging->idle = g_idle_add(__staging_notify, staging);
+	}
+
+	pthread_mutex_unlock(&staging->lock);
+
+	return NULL;
+}
+
+static void __free_entry(gpointer data)
+{
+	staging_entry *entry = data;
+
+	if (entry->staged) {
+		unlink(entry->staged);
+		free(entry->staged);
+	}
+	free(entry->path);
+	free(entry);
+}
+
+static int __staging_create(const char *dir, void (*ready_cb) (void *data),
+			    void *ready_data,
+			    package_manager_staging_s **staging)
+{
+	package_manager_staging_s *s;
+	struct stat st;
+
+	if (stat(dir, &st) < 0 || !S_ISDIR(st.st_mode))
+		return PACKAGE_MANAGER_ERROR_INVALID_PARAMETER;
+
+	s = calloc(1, sizeof(package_manager_staging_s));
+	if (s)
+		s->dir = strdup(dir);
+	if (s == NULL || s->dir == NULL) {
+		free(s);
+		return PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY;
+	}
+
+	s->ready_cb = ready_cb;
+	s->ready_data = ready_data;
+	s->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+					   __free_entry);
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->queued, NULL);
+	pthread_cond_init(&s->copied, NULL);
+
+	*staging = s;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+void __staging_destroy(package_manager_staging_s *staging)
+{
+	pthread_mutex_lock(&staging->lock);
+	staging->stopping = true;
+	pthread_cond_signal(&staging->queued);
+	pthread_cond_broadcast(&staging->copied);
+	pthread_mutex_unlock(&staging->lock);
+
+	/* The copy in progress is finished, the queued ones are dropped */
+	if (staging->running)
+		pthread_join(staging->thread, NULL);
+
+	if (staging->idle)
+		g_source_remove(staging->idle);
+
+	g_hash_table_destroy(staging->entries);
+	pthread_cond_destroy(&staging->copied);
+	pthread_cond_destroy(&staging->queued);
+	pthread_mutex_destroy(&staging->lock);
+	free(staging->dir);
+	free(staging);
+}
+
+/* Called with the lock held */
+static staging_entry *__enqueue(package_manager_staging_s *staging,
+				const char *path, bool first)
+{
+	staging_entry *entry;
+
+	entry = calloc(1, sizeof(staging_entry));
+	if (entry)
+		entry->path = strdup(path);
+	if (entry == NULL || entry->path == NULL) {
+		free(entry);
+		return NULL;
+	}
+
+	if (!staging->running) {
+		if (pthread_create(&staging->thread, NULL, __staging_main,
+				   staging) != 0) {
+			free(entry->path);
+			free(entry);
+			return NULL;
+		}
+		staging->running = true;
+	}
+
+	entry->state = STAGING_QUEUED;
+	g_hash_table_insert(staging->entries, entry->path, entry);
+	if (first) {
+		entry->next = staging->head;
+		staging->head = entry;
+		if (staging->tail == NULL)
+			staging->tail = entry;
+	} else {
+		if (staging->tail)
+			staging->tail->next = entry;
+		else
+			staging->head = entry;
+		staging->tail = entry;
+	}
+	pthread_cond_signal(&staging->queued);
+
+	return entry;
+}
+
+static void __unqueue(package_manager_staging_s *staging, staging_entry *entry)
+{
+	staging_entry **link;
+
+	for (link = &staging->head; *link; link = &(*link)->next) {
+		if (*link != entry)
+			continue;
+		*link = entry->next;
+		if (staging->tail == entry) {
+			staging->tail = NULL;
+			if (staging->head) {
+				staging->tail = staging->head;
+				while (staging->tail->next)
+					staging->tail = staging->tail->next;
+			}
+		}
+		entry->next = NULL;
+		return;
+	}
+}
+
+/* Moves a file needed now to the front of the queue */
+static void __promote(package_manager_staging_s *staging, staging_entry *entry)
+{
+	__unqueue(staging, entry);
+
+	entry->next = staging->head;
+	staging->head = entry;
+	if (staging->tail == NULL)
+		staging->tail = entry;
+}
+
+int __staging_queue(package_manager_staging_s *staging, const char *path)
+{
+	int ret = PACKAGE_MANAGER_ERROR_NONE;
+
+	pthread_mutex_lock(&staging->lock);
+
+	if (g_hash_table_lookup(staging->entries, path) == NULL
+	    && __enqueue(staging, path, false) == NULL)
+		ret = PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY;
+
+	pthread_mutex_unlock(&staging->lock);
+
+	return ret;
+}
+
+/*
+ * Whether __staging_take() would return without waiting. Otherwise the
+ * copy is moved ahead of the others, and the ready callback is invoked
+ * once it is done.
+ */
+bool __staging_ready(package_manager_staging_s *staging, const char *path)
+{
+	staging_entry *entry;
+	bool ready = false;
+
+	pthread_mutex_lock(&staging->lock);
+
+	entry = g_hash_table_lookup(staging->entries, path);
+	if (entry == NULL) {
+		/* Installed from where it is if it cannot even be queued */
+		if (__enqueue(staging, path, true) == NULL)
+			ready = true;
+	} else if (entry->state == STAGING_QUEUED) {
+		__promote(staging, entry);
+	} else if (entry->state == STAGING_DONE) {
+		ready = true;
+	}
+
+	pthread_mutex_unlock(&staging->lock);
+
+	return ready;
+}
+
+/*
+ * Waits in the calling thread for the copy, ahead of __staging_take().
+ * The thread running the main loop does not wait.
+ */
+void __staging_prepare(package_manager_staging_s *staging, const char *path)
+{
+	staging_entry *entry;
+
+	if (g_main_context_is_owner(g_main_context_default()))
+		return;
+
+	pthread_mutex_lock(&staging->lock);
+
+	entry = g_hash_table_lookup(staging->entries, path);
+	if (entry == NULL)
+		entry = __enqueue(staging, path, true);
+	else if (entry->state == STAGING_QUEUED)
+		__promote(staging, entry);
+
+	/* Until done, discarded or dropped with the staging */
+	while (entry && entry->state != STAGING_DONE && !staging->stopping
+	       && g_hash_table_lookup(staging->entries, path) == entry)
+		pthread_cond_wait(&staging->copied, &staging->lock);
+
+	pthread_mutex_unlock(&staging->lock);
+}
+
+/* Drops the copy of a file which is not going to be installed */
+void __staging_discard(package_manager_staging_s *staging, const char *path)
+{
+	staging_entry *entry;
+
+	pthread_mutex_lock(&staging->lock);
+
+	entry = g_hash_table_lookup(staging->entries, path);
+	if (entry && entry->state == STAGING_COPYING) {
+		entry->discarded = true;
+	} else if (entry) {
+		if (entry->state == STAGING_QUEUED)
+			__unqueue(staging, entry);
+		g_hash_table_remove(staging->entries, path);
+		pthread_cond_broadcast(&staging->copied);
+	}
+
+	pthread_mutex_unlock(&staging->lock);
+}
+
+/*
+ * Hands over the copy of a file, which the caller must release. Never
+ * waits: without a finished copy, *staged is NULL and the file is to be
+ * installed from where it is.
+ */
+int __staging_take(package_manager_staging_s *staging, const char *path,
+		   char **staged)
+{
+	staging_entry *entry;
+	int ret = PACKAGE_MANAGER_ERROR_NONE;
+
+	*staged = NULL;
+
+	pthread_mutex_lock(&staging->lock);
+
+	entry = g_hash_table_lookup(staging->entries, path);
+	if (entry && entry->state == STAGING_DONE) {
+		ret = entry->error;
+		*staged = entry->staged;
+		entry->staged = NULL;
+		g_hash_table_remove(staging->entries, path);
+	} else if (entry) {
+		LOGW("%s is not staged yet, installing it in place", path);
+		pthread_mutex_unlock(&staging->lock);
+		__staging_discard(staging, path);
+		return PACKAGE_MANAGER_ERROR_NONE;
+	}
+
+	pthread_mutex_unlock(&staging->lock);
+
+	return ret;
+}
+
+void __staging_release(char *staged)
+{
+	if (staged == NULL)
+		return;
+
+	unlink(staged);
+	free(staged);
+}
+
+/* Runs on the thread dispatching the events, see __main_invoke() */
+static int __staging_resume(void *data)
+{
+	__request_staged(data);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_request_set_staging_dir(package_manager_request_h request,
+					    const char *dir)
+{
+	package_manager_staging_s *staging = NULL;
+	int ret;
+
+	if (package_manager_client_valiate_handle(request)) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	if (dir) {
+		ret = __staging_create(dir, __request_staged, request,
+				       &staging);
+		if (ret != PACKAGE_MANAGER_ERROR_NONE)
+			return package_manager_error(ret, __FUNCTION__, dir);
+	}
+
+	if (request->staging)
+		__staging_destroy(request->staging);
+	request->staging = staging;
+
+	/* What waited for the dropped copies goes on with the new directory */
+	__main_invoke(__staging_resume, request);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_request_stage(package_manager_request_h request,
+				  const char *path)
+{
+	int ret;
+
+	if (package_manager_client_valiate_handle(request) || path == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	if (request->staging == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     "no staging directory is set");
+	}
+
+	ret = __staging_queue(request->staging, path);
+	if (ret != PACKAGE_MANAGER_ERROR_NONE)
+		return package_manager_error(ret, __FUNCTION__, path);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
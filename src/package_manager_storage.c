@@ -0,0 +1,593 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <glib.h>
+#include <dlog.h>
+
+#include <package_manager_private.h>
+
+#define PACKAGE_MANAGER_APPS_DIR "/opt/usr/apps"
+
+#define STORAGE_WATCH_MASK (IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | \
+			    IN_MOVED_FROM | IN_MOVED_TO | \
+			    IN_DONT_FOLLOW | IN_ONLYDIR)
+
+typedef struct _storage_package {
+	char *name;
+	unsigned long long size;
+	bool exceeded;
+	GHashTable *files;	/* path -> unsigned long long */
+} storage_package;
+
+typedef struct _storage_watch {
+	char *path;
+	storage_package *package;
+} storage_watch;
+
+/*
+ * The totals are updated on the main loop and may be read from any thread.
+ * The lock is recursive so that the callback may read them as well.
+ */
+struct package_manager_storage_s {
+	pthread_mutex_t lock;
+	int fd;
+	GIOChannel *channel;
+	guint source;
+	GHashTable *packages;	/* name -> storage_package */
+	GHashTable *watches;	/* wd -> storage_watch */
+	unsigned long long total;
+	unsigned long long threshold;
+	package_manager_storage_cb callback;
+	void *user_data;
+};
+
+static void __free_package(gpointer data)
+{
+	storage_package *package = data;
+
+	g_hash_table_destroy(package->files);
+	free(package->name);
+	free(package);
+}
+
+static void __free_watch(gpointer data)
+{
+	storage_watch *watch = data;
+
+	free(watch->path);
+	free(watch);
+}
+
+static void __check_threshold(package_manager_storage_s *storage,
+			      storage_package *package)
+{
+	bool exceeded;
+
+	if (storage->threshold == 0)
+		return;
+
+	exceeded = package->size >= storage->threshold;
+	if (exceeded == package->exceeded)
+		return;
+
+	package->exceeded = exceeded;
+
+	if (storage->callback)
+		storage->callback(package->name, package->size, exceeded,
+				  storage->user_data);
+}
+
+static void __resize(package_manager_storage_s *storage,
+		     storage_package *package, unsigned long long old_size,
+		     unsigned long long new_size)
+{
+	package->size = package->size - old_size + new_size;
+	storage->total = storage->total - old_size + new_size;
+}
+
+static void __update_file(package_manager_storage_s *storage,
+			  storage_package *package, const char *path)
+{
+	struct stat st;
+	unsigned long long *cached;
+	unsigned long long size;
+
+	cached = g_hash_table_lookup(package->files, path);
+
+	if (lstat(path, &st) != 0 || S_ISDIR(st.st_mode)) {
+		if (cached) {
+			__resize(storage, package, *cached, 0);
+			g_hash_table_remove(package->files, path);
+		}
+		return;
+	}
+
+	size = (unsigned long long)st.st_blocks * 512;
+
+	if (cached == NULL) {
+		cached = calloc(1, sizeof(unsigned long long));
+		if (cached == NULL) {
+			LOGE("calloc failed");
+			return;
+		}
+		g_hash_table_insert(package->files, strdup(path), cached);
+	}
+
+	__resize(storage, package, *cached, size);
+	*cached = size;
+}
+
+static void __scan_dir(package_manager_storage_s *storage,
+		       storage_package *package, const char *path)
+{
+	DIR *dir;
+	struct dirent *entry;
+	struct stat st;
+	storage_watch *watch;
+	char *child;
+	int wd;
+
+	wd = inotify_add_watch(storage->fd, path, STORAGE_WATCH_MASK);
+	if (wd < 0) {
+		LOGE("failed to watch %s", path);
+	} else {
+		watch = calloc(1, sizeof(storage_watch));
+		if (watch) {
+			watch->path = strdup(path);
+			watch->package = package;
+			g_hash_table_replace(storage->watches,
+					     GINT_TO_POINTER(wd), watch);
+		}
+	}
+
+	dir = opendir(path);
+	if (dir == NULL)
+		return;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0
+		    || strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		child = g_build_filename(path, entry->d_name, NULL);
+		if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode))
+			__scan_dir(storage, package, child);
+		else
+			__update_file(storage, package, child);
+		g_free(child);
+	}
+
+	closedir(dir);
+}
+
+static void __forget_dir(package_manager_storage_s *storage,
+			 storage_package *package, const char *path)
+{
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	storage_watch *watch;
+	size_t len = strlen(path);
+
+	g_hash_table_iter_init(&iter, package->files);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (strncmp(key, path, len) == 0 && ((char *)key)[len] == '/') {
+			__resize(storage, package,
+				 *(unsigned long long *)value, 0);
+			g_hash_table_iter_remove(&iter);
+		}
+	}
+
+	g_hash_table_iter_init(&iter, storage->watches);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		watch = value;
+		if (strncmp(watch->path, path, len) == 0
+		    && (watch->path[len] == '/' || watch->path[len] == '\0')) {
+			inotify_rm_watch(storage->fd, GPOINTER_TO_INT(key));
+			g_hash_table_iter_remove(&iter);
+		}
+	}
+}
+
+static void __remove_package(package_manager_storage_s *storage,
+			     const char *name)
+{
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	storage_package *package;
+
+	package = g_hash_table_lookup(storage->packages, name);
+	if (package == NULL)
+		return;
+
+	g_hash_table_iter_init(&iter, storage->watches);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (((storage_watch *)value)->package == package) {
+			inotify_rm_watch(storage->fd, GPOINTER_TO_INT(key));
+			g_hash_table_iter_remove(&iter);
+		}
+	}
+
+	storage->total -= package->size;
+	g_hash_table_remove(storage->packages, name);
+}
+
+static void __add_package(package_manager_storage_s *storage,
+			  const char *name)
+{
+	struct stat st;
+	storage_package *package;
+	bool exceeded = false;
+	char *root;
+
+	package = g_hash_table_lookup(storage->packages, name);
+	if (package)
+		exceeded = package->exceeded;
+
+	__remove_package(storage, name);
+
+	root = g_build_filename(PACKAGE_MANAGER_APPS_DIR, name, NULL);
+	if (stat(root, &st) != 0 || !S_ISDIR(st.st_mode)) {
+		g_free(root);
+		return;
+	}
+
+	package = calloc(1, sizeof(storage_package));
+	if (package == NULL) {
+		LOGE("calloc failed");
+		g_free(root);
+		return;
+	}
+
+	package->name = strdup(name);
+	package->exceeded = exceeded;
+	package->files = g_hash_table_new_full(g_str_hash, g_str_equal,
+					       free, free);
+	g_hash_table_insert(storage->packages, package->name, package);
+
+	__scan_dir(storage, package, root);
+	__check_threshold(storage, package);
+
+	g_free(root);
+}
+
+/* Rebuilds the table, dropping the packages which are no longer there */
+static void __scan_packages(package_manager_storage_s *storage)
+{
+	DIR *dir;
+	struct dirent *entry;
+	GHashTable *found;
+	GHashTableIter iter;
+	gpointer key;
+	GSList *gone = NULL;
+	GSList *l;
+
+	dir = opendir(PACKAGE_MANAGER_APPS_DIR);
+	if (dir == NULL) {
+		LOGE("failed to open %s", PACKAGE_MANAGER_APPS_DIR);
+		return;
+	}
+
+	found = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0
+		    || strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		__add_package(storage, entry->d_name);
+		if (found)
+			g_hash_table_replace(found, strdup(entry->d_name),
+					     GINT_TO_POINTER(1));
+	}
+
+	closedir(dir);
+
+	if (found == NULL)
+		return;
+
+	g_hash_table_iter_init(&iter, storage->packages);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		if (g_hash_table_lookup(found, key) == NULL)
+			gone = g_slist_prepend(gone, key);
+
+	for (l = gone; l; l = l->next)
+		__remove_package(storage, l->data);
+
+	g_slist_free(gone);
+	g_hash_table_destroy(found);
+}
+
+static void __handle_inotify_event(package_manager_storage_s *storage,
+				   const struct inotify_event *ev)
+{
+	storage_watch *watch;
+	storage_package *package;
+	char *path;
+
+	if (ev->mask & IN_Q_OVERFLOW) {
+		LOGE("inotify queue overflowed, rescanning packages");
+		__scan_packages(storage);
+		return;
+	}
+
+	if (ev->mask & IN_IGNORED) {
+		g_hash_table_remove(storage->watches, GINT_TO_POINTER(ev->wd));
+		return;
+	}
+
+	watch = g_hash_table_lookup(storage->watches, GINT_TO_POINTER(ev->wd));
+	if (watch == NULL || ev->len == 0)
+		return;
+
+	package = watch->package;
+	path = g_build_filename(watch->path, ev->name, NULL);
+
+	if (ev->mask & IN_ISDIR) {
+		if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+			__scan_dir(storage, package, path);
+		else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+			__forget_dir(storage, package, path);
+	} else {
+		__update_file(storage, package, path);
+	}
+
+	__check_threshold(storage, package);
+
+	g_free(path);
+}
+
+static gboolean __inotify_cb(GIOChannel *channel, GIOCondition condition,
+			     gpointer data)
+{
+	package_manager_storage_s *storage = data;
+	char buf[4096]
+	    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t len;
+	char *ptr;
+
+	if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		LOGE("inotify channel closed");
+		storage->source = 0;
+		return FALSE;
+	}
+
+	pthread_mutex_lock(&storage->lock);
+
+	while ((len = read(storage->fd, buf, sizeof(buf))) > 0) {
+		for (ptr = buf; ptr < buf + len;
+		     ptr += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *)ptr;
+			__handle_inotify_event(storage, ev);
+		}
+	}
+
+	pthread_mutex_unlock(&storage->lock);
+
+	return TRUE;
+}
+
+void __storage_destroy(package_manager_storage_s *storage)
+{
+	if (storage->source)
+		g_source_remove(storage->source);
+	if (storage->channel)
+		g_io_channel_unref(storage->channel);
+	if (storage->watches)
+		g_hash_table_destroy(storage->watches);
+	if (storage->packages)
+		g_hash_table_destroy(storage->packages);
+	if (storage->fd >= 0)
+		close(storage->fd);
+	pthread_mutex_destroy(&storage->lock);
+	free(storage);
+}
+
+static int __storage_create(package_manager_storage_s **storage)
+{
+	package_manager_storage_s *s;
+	pthread_mutexattr_t attr;
+
+	s = calloc(1, sizeof(package_manager_storage_s));
+	if (s == NULL)
+		return PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&s->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	s->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (s->fd < 0) {
+		pthread_mutex_destroy(&s->lock);
+		free(s);
+		return PACKAGE_MANAGER_ERROR_IO_ERROR;
+	}
+
+	s->packages = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+					    __free_package);
+	s->watches = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					   NULL, __free_watch);
+	s->channel = g_io_channel_unix_new(s->fd);
+	if (s->packages == NULL || s->watches == NULL || s->channel == NULL) {
+		__storage_destroy(s);
+		return PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY;
+	}
+
+	s->source = g_io_add_watch(s->channel,
+				   G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+				   __inotify_cb, s);
+
+	*storage = s;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+void __storage_handle_event(package_manager_storage_s *storage,
+			    const char *pkg_name,
+			    package_manager_event_type_e event_type)
+{
+	if (pkg_name == NULL)
+		return;
+
+	pthread_mutex_lock(&storage->lock);
+
+	switch (event_type) {
+	case PACAKGE_MANAGER_EVENT_TYPE_INSTALL:
+	case PACAKGE_MANAGER_EVENT_TYPE_UPDATE:
+		__add_package(storage, pkg_name);
+		break;
+	case PACAKGE_MANAGER_EVENT_TYPE_UNINSTALL:
+		__remove_package(storage, pkg_name);
+		break;
+	default:
+		break;
+	}
+
+	pthread_mutex_unlock(&storage->lock);
+}
+
+int package_manager_set_storage_cb(package_manager_h manager,
+				   unsigned long long threshold,
+				   package_manager_storage_cb callback,
+				   void *user_data)
+{
+	GHashTableIter iter;
+	gpointer value;
+	int ret;
+
+	if (package_manager_valiate_handle(manager)) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	if (manager->storage) {
+		pthread_mutex_lock(&manager->storage->lock);
+
+		manager->storage->threshold = threshold;
+		manager->storage->callback = callback;
+		manager->storage->user_data = user_data;
+
+		g_hash_table_iter_init(&iter, manager->storage->packages);
+		while (g_hash_table_iter_next(&iter, NULL, &value))
+			__check_threshold(manager->storage, value);
+
+		pthread_mutex_unlock(&manager->storage->lock);
+
+		return PACKAGE_MANAGER_ERROR_NONE;
+	}
+
+	ret = __storage_create(&manager->storage);
+	if (ret != PACKAGE_MANAGER_ERROR_NONE) {
+		return package_manager_error(ret, __FUNCTION__,
+					     "failed to create the storage tracker");
+	}
+
+	manager->storage->threshold = threshold;
+	manager->storage->callback = callback;
+	manager->storage->user_data = user_data;
+
+	pthread_mutex_lock(&manager->storage->lock);
+	__scan_packages(manager->storage);
+	pthread_mutex_unlock(&manager->storage->lock);
+
+	ret = __package_manager_listen(manager);
+	if (ret != PACKAGE_MANAGER_ERROR_NONE) {
+		__storage_destroy(manager->storage);
+		manager->storage = NULL;
+		return ret;
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_unset_storage_cb(package_manager_h manager)
+{
+	if (package_manager_valiate_handle(manager)) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	if (manager->storage) {
+		__storage_destroy(manager->storage);
+		manager->storage = NULL;
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_get_package_storage_size(package_manager_h manager,
+					     const char *package,
+					     unsigned long long *size)
+{
+	storage_package *p;
+
+	if (package_manager_valiate_handle(manager) || manager->storage == NULL
+	    || package == NULL || size == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	pthread_mutex_lock(&manager->storage->lock);
+
+	p = g_hash_table_lookup(manager->storage->packages, package);
+	if (p == NULL) {
+		pthread_mutex_unlock(&manager->storage->lock);
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     "no such package");
+	}
+
+	*size = p->size;
+
+	pthread_mutex_unlock(&manager->storage->lock);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_get_total_storage_size(package_manager_h manager,
+					   unsigned long long *size)
+{
+	if (package_manager_valiate_handle(manager) || manager->storage == NULL
+	    || size == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	pthread_mutex_lock(&manager->storage->lock);
+	*size = manager->storage->total;
+	pthread_mutex_unlock(&manager->storage->lock);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <glib.h>
+#include <dlog.h>
+
+#include <package_manager_private.h>
+
+#define TIMER_TICK_MS 100
+#define TIMER_LEVELS 4
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+#define TIMER_SLOT_MASK (TIMER_SLOTS - 1)
+#define TIMER_MAX_TICKS ((1ULL << (TIMER_LEVELS * TIMER_SLOT_BITS)) - 1)
+
+#define TIMER_INDEX(ticks, level) \
+	(((ticks) >> ((level) * TIMER_SLOT_BITS)) & TIMER_SLOT_MASK)
+
+/*
+ * Request timeouts are kept in a hierarchical timer wheel driven from the
+ * main loop. Level 0 has one slot per tick, and each higher level covers a
+ * whole turn of the level below it; when a lower level wraps around, the
+ * matching slot of the next level is cascaded down. Starting or stopping a
+ * timer is O(1), and a tick only touches the timers that are due, however
+ * many requests are outstanding. With 100ms ticks, four levels of 64 slots
+ * reach about 19 days.
+ *
+ * The wheel is guarded by wheel_lock, which is not held while the
+ * callbacks run, so that they may start or stop timers.
+ */
+static pthread_mutex_t wheel_lock = PTHREAD_MUTEX_INITIALIZER;
+static package_manager_timer *wheel[TIMER_LEVELS][TIMER_SLOTS];
+static unsigned long long wheel_ticks;
+static unsigned int wheel_count;
+static guint wheel_source;
+
+static unsigned long long __current_ticks(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((unsigned long long)now.tv_sec * 1000 +
+		now.tv_nsec / 1000000) / TIMER_TICK_MS;
+}
+
+static void __timer_link(package_manager_timer **slot,
+			 package_manager_timer *timer)
+{
+	timer->next = *slot;
+	if (timer->next)
+		timer->next->pprev = &timer->next;
+	timer->pprev = slot;
+	*slot = timer;
+}
+
+static void __timer_unlink(package_manager_timer *timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next)
+		timer->next->pprev = timer->pprev;
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+static void __timer_insert(package_manager_timer *timer)
+{
+	unsigned long long delta;
+	int level;
+
+	if (timer->expires <= wheel_ticks) {
+		__timer_link(&wheel[0][TIMER_INDEX(wheel_ticks, 0)], timer);
+		return;
+	}
+
+	delta = timer->expires - wheel_ticks;
+	for (level = 0; level < TIMER_LEVELS - 1; level++) {
+		if (delta < 1ULL << ((level + 1) * TIMER_SLOT_BITS))
+			break;
+	}
+
+	__timer_link(&wheel[level][TIMER_INDEX(timer->expires, level)],
+		     timer);
+}
+
+/* Moves the timers of a slot down to the lower levels */
+static bool __timer_cascade(int level)
+{
+	package_manager_timer *pending;
+	package_manager_timer *timer;
+	int index = TIMER_INDEX(wheel_ticks, level);
+
+	pending = wheel[level][index];
+	wheel[level][index] = NULL;
+
+	while (pending) {
+		timer = pending;
+		pending = timer->next;
+		__timer_insert(timer);
+	}
+
+	return index == 0;
+}
+
+static void __timer_step(void)
+{
+	package_manager_timer *pending;
+	package_manager_timer *timer;
+	int index = TIMER_INDEX(wheel_ticks, 0);
+	int level;
+
+	if (index == 0) {
+		for (level = 1; level < TIMER_LEVELS; level++) {
+			if (!__timer_cascade(level))
+				break;
+		}
+	}
+
+	/* Detach the due timers so that callbacks may start or stop others */
+	pending = wheel[0][index];
+	wheel[0][index] = NULL;
+	if (pending)
+		pending->pprev = &pending;
+
+	wheel_ticks++;
+
+	/* Timers stopped meanwhile are unlinked from pending */
+	while (pending) {
+		timer = pending;
+		__timer_unlink(timer);
+		wheel_count--;
+
+		pthread_mutex_unlock(&wheel_lock);
+		timer->callback(timer, timer->data);
+		pthread_mutex_lock(&wheel_lock);
+	}
+}
+
+static gboolean __timer_tick(gpointer data)
+{
+	unsigned long long now = __current_ticks();
+
+	pthread_mutex_lock(&wheel_lock);
+
+	/* Catch up if the main loop has been busy */
+	while (wheel_ticks <= now && wheel_count > 0)
+		__timer_step();
+
+	if (wheel_count > 0) {
+		pthread_mutex_unlock(&wheel_lock);
+		return TRUE;
+	}
+
+	wheel_source = 0;
+
+	pthread_mutex_unlock(&wheel_lock);
+
+	return FALSE;
+}
+
+static void __timer_cancel(package_manager_timer *timer)
+{
+	if (timer->pprev == NULL)
+		return;
+
+	__timer_unlink(timer);
+	wheel_count--;
+}
+
+void __timer_start(package_manager_timer *timer, int timeout,
+		   package_manager_timer_cb callback, void *data)
+{
+	unsigned long long now = __current_ticks();
+	unsigned long long ticks;
+
+	/* Rounded up without overflowing for timeouts close to INT_MAX */
+	ticks = ((unsigned long long)timeout + TIMER_TICK_MS - 1) /
+	    TIMER_TICK_MS;
+	if (ticks == 0)
+		ticks = 1;
+	if (ticks > TIMER_MAX_TICKS)
+		ticks = TIMER_MAX_TICKS;
+
+	pthread_mutex_lock(&wheel_lock);
+
+	__timer_cancel(timer);
+
+	if (wheel_count == 0)
+		wheel_ticks = now;
+
+	timer->expires = now + ticks;
+	timer->callback = callback;
+	timer->data = data;
+
+	__timer_insert(timer);
+	wheel_count++;
+
+	if (wheel_source == 0)
+		wheel_source = g_timeout_add(TIMER_TICK_MS, __timer_tick, NULL);
+
+	pthread_mutex_unlock(&wheel_lock);
+}
+
+void __timer_stop(package_manager_timer *timer)
+{
+	pthread_mutex_lock(&wheel_lock);
+	__timer_cancel(timer);
+	pthread_mutex_unlock(&wheel_lock);
+}
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <dlog.h>
+
+#include <package_manager_private.h>
+
+struct package_manager_transaction_s {
+	package_manager_request_h request;
+	transaction_member *head;
+	transaction_member *tail;
+	int count;
+	int finished;
+	int failed;
+	int progress_sum;
+	int progress;
+	bool committed;
+	package_manager_transaction_event_cb event_cb;
+	void *user_data;
+};
+
+static int package_manager_transaction_validate_handle(package_manager_transaction_h
+						       transaction)
+{
+	if (transaction == NULL || transaction->request == NULL) {
+		return PACKAGE_MANAGER_ERROR_INVALID_PARAMETER;
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+static bool __is_finished(package_manager_event_state_e event_state)
+{
+	return event_state == PACAKGE_MANAGER_EVENT_STATE_COMPLETED
+	    || event_state == PACAKGE_MANAGER_EVENT_STATE_FAILED;
+}
+
+/* Called when the request is destroyed before the transaction */
+void __transaction_detach(package_manager_transaction_h transaction)
+{
+	transaction->request = NULL;
+}
+
+void __transaction_member_event(transaction_member *member,
+				const char *pkg_name,
+				package_manager_event_state_e event_state,
+				int progress, package_manager_error_e error)
+{
+	package_manager_transaction_h transaction = member->transaction;
+	int aggregated;
+
+	if (__is_finished(member->event_state))
+		return;
+
+	if (pkg_name && member->package == NULL)
+		member->package = strdup(pkg_name);
+
+	if (__is_finished(event_state))
+		progress = 100;
+	else if (progress < 0)
+		progress = 0;
+	else if (progress > 100)
+		progress = 100;
+
+	transaction->progress_sum += progress - member->progress;
+	member->progress = progress;
+	member->event_state = event_state;
+	member->error = error;
+
+	if (__is_finished(event_state)) {
+		transaction->finished++;
+		if (event_state == PACAKGE_MANAGER_EVENT_STATE_FAILED)
+			transaction->failed++;
+	}
+
+	if (transaction->event_cb == NULL)
+		return;
+
+	if (transaction->finished == transaction->count) {
+		transaction->progress = 100;
+		transaction->event_cb(transaction,
+				      transaction->failed ?
+				      PACAKGE_MANAGER_EVENT_STATE_FAILED :
+				      PACAKGE_MANAGER_EVENT_STATE_COMPLETED,
+				      100, transaction->user_data);
+		return;
+	}
+
+	aggregated = transaction->progress_sum / transaction->count;
+	if (aggregated != transaction->progress) {
+		transaction->progress = aggregated;
+		transaction->event_cb(transaction,
+				      PACAKGE_MANAGER_EVENT_STATE_PROCESSING,
+				      aggregated, transaction->user_data);
+	}
+}
+
+int package_manager_transaction_begin(package_manager_request_h request,
+				      package_manager_transaction_h *transaction)
+{
+	struct package_manager_transaction_s *package_manager_transaction;
+
+	if (package_manager_client_valiate_handle(request)
+	    || transaction == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	package_manager_transaction =
+	    calloc(1, sizeof(struct package_manager_transaction_s));
+	if (package_manager_transaction == NULL) {
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY,
+					  __FUNCTION__,
+					  "failed to create a transaction handle");
+	}
+
+	package_manager_transaction->request = request;
+	request->transactions = g_slist_prepend(request->transactions,
+						package_manager_transaction);
+
+	*transaction = package_manager_transaction;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+static int __transaction_add(package_manager_transaction_h transaction,
+			     package_manager_event_type_e event_type,
+			     const char *target, const char *function)
+{
+	transaction_member *member;
+
+	if (package_manager_transaction_validate_handle(transaction)
+	    || transaction->committed || target == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, function, NULL);
+	}
+
+	member = calloc(1, sizeof(transaction_member));
+	if (member == NULL) {
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY,
+					  function, NULL);
+	}
+
+	member->target = strdup(target);
+	if (member->target == NULL) {
+		free(member);
+		return
+		    package_manager_error(PACKAGE_MANAGER_ERROR_OUT_OF_MEMORY,
+					  function, NULL);
+	}
+
+	member->transaction = transaction;
+	member->req_id = -1;
+	member->event_type = event_type;
+	member->event_state = PACAKGE_MANAGER_EVENT_STATE_STARTED;
+	member->error = PACKAGE_MANAGER_ERROR_NONE;
+
+	if (transaction->tail)
+		transaction->tail->next = member;
+	else
+		transaction->head = member;
+	transaction->tail = member;
+	transaction->count++;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_transaction_add_install(package_manager_transaction_h transaction,
+					    const char *path)
+{
+	return __transaction_add(transaction,
+				 PACAKGE_MANAGER_EVENT_TYPE_INSTALL, path,
+				 __FUNCTION__);
+}
+
+int package_manager_transaction_add_uninstall(package_manager_transaction_h transaction,
+					      const char *name)
+{
+	return __transaction_add(transaction,
+				 PACAKGE_MANAGER_EVENT_TYPE_UNINSTALL, name,
+				 __FUNCTION__);
+}
+
+typedef struct _commit_call {
+	package_manager_transaction_h transaction;
+	package_manager_transaction_event_cb callback;
+	void *user_data;
+} commit_call;
+
+/* A member submitted once its file was staged */
+static void __member_submitted(void *owner, int ret, int id,
+			       event_info *info)
+{
+	transaction_member *member = owner;
+
+	member->req_id = id;
+
+	/* Detached from the request, the transaction is no longer reported */
+	if (member->transaction->request == NULL)
+		return;
+
+	if (info)
+		info->member = member;
+	else
+		__transaction_member_event(member, NULL,
+					   PACAKGE_MANAGER_EVENT_STATE_FAILED,
+					   100, ret);
+}
+
+/* Runs on the thread dispatching the events, see __main_invoke() */
+static int __transaction_submit(void *data)
+{
+	commit_call *call = data;
+	package_manager_transaction_h transaction = call->transaction;
+	transaction_member *member;
+	event_info *info;
+	int ret;
+	int first_error = PACKAGE_MANAGER_ERROR_NONE;
+
+	/* Installations whose file is not staged yet are submitted later */
+	for (member = transaction->head; member; member = member->next) {
+		if (member->event_type == PACAKGE_MANAGER_EVENT_TYPE_INSTALL)
+			ret = __request_submit_staged(transaction->request,
+						      member->target,
+						      &member->req_id, &info,
+						      __member_submitted,
+						      member);
+		else
+			ret = __request_submit(transaction->request,
+					       member->event_type,
+					       member->target,
+					       &member->req_id, &info);
+		if (ret == PACKAGE_MANAGER_ERROR_NONE) {
+			if (info)
+				info->member = member;
+			continue;
+		}
+
+		LOGE("failed to submit %s (%d)", member->target, ret);
+
+		if (first_error == PACKAGE_MANAGER_ERROR_NONE)
+			first_error = ret;
+
+		__transaction_member_event(member, NULL,
+					   PACAKGE_MANAGER_EVENT_STATE_FAILED,
+					   100, ret);
+	}
+
+	if (transaction->finished == transaction->count)
+		return first_error;
+
+	transaction->event_cb = call->callback;
+	transaction->user_data = call->user_data;
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_transaction_commit(package_manager_transaction_h transaction,
+				       package_manager_transaction_event_cb callback,
+				       void *user_data)
+{
+	commit_call call = {
+		.transaction = transaction,
+		.callback = callback,
+		.user_data = user_data,
+	};
+	package_manager_staging_s *staging;
+	transaction_member *member;
+	int ret;
+
+	if (package_manager_transaction_validate_handle(transaction)
+	    || transaction->committed || transaction->count == 0) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	transaction->committed = true;
+
+	/* Copied one after the other while the first ones are installed */
+	staging = transaction->request->staging;
+	if (staging) {
+		for (member = transaction->head; member; member = member->next)
+			if (member->event_type ==
+			    PACAKGE_MANAGER_EVENT_TYPE_INSTALL)
+				__staging_queue(staging, member->target);
+	}
+
+	ret = __main_invoke(__transaction_submit, &call);
+	if (ret != PACKAGE_MANAGER_ERROR_NONE) {
+		return package_manager_error(ret, __FUNCTION__,
+					     "no operation could be submitted");
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_transaction_foreach_member(package_manager_transaction_h transaction,
+					       package_manager_transaction_member_cb callback,
+					       void *user_data)
+{
+	transaction_member *member;
+
+	if (transaction == NULL || callback == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	for (member = transaction->head; member; member = member->next) {
+		if (!callback(member->req_id,
+			      member->package ? member->package : member->target,
+			      member->event_type, member->event_state,
+			      member->error, user_data))
+			break;
+	}
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}
+
+int package_manager_transaction_destroy(package_manager_transaction_h transaction)
+{
+	transaction_member *member;
+
+	if (transaction == NULL) {
+		return
+		    package_manager_error
+		    (PACKAGE_MANAGER_ERROR_INVALID_PARAMETER, __FUNCTION__,
+		     NULL);
+	}
+
+	if (transaction->request) {
+		if (transaction->committed) {
+			__request_detach_members(transaction->request,
+						 transaction);
+			for (member = transaction->head; member;
+			     member = member->next)
+				__request_cancel_submit(transaction->request,
+							member);
+		}
+		transaction->request->transactions =
+		    g_slist_remove(transaction->request->transactions,
+				   transaction);
+	}
+
+	while (transaction->head) {
+		member = transaction->head;
+		transaction->head = member->next;
+		free(member->target);
+		free(member->package);
+		free(member);
+	}
+
+	transaction->request = NULL;
+	free(transaction);
+
+	return PACKAGE_MANAGER_ERROR_NONE;
+}